@@ -31,8 +31,8 @@ int main()
             if (boost::this_fiber::interrupted())
                 break;
 
-            // 让出cpu, 此时会进入fiber的slepp队列, 此时优先级低于准备队列
-            boost::this_fiber::sleep_for(std::chrono::milliseconds(5));
+            // 让出cpu, 此时会进入池的时间轮, 到期后才重新进入准备队列
+            fiber_pool::this_fiber::sleep_for(std::chrono::milliseconds(5));
 
             if (frist != boost::this_thread::get_id())
                 std::cout << "The thread has been switched!" << std::endl;
@@ -1,11 +1,54 @@
 #include "fiber_pool.hpp"
+#include "fiber_parallel.hpp"
+#include "fiber_graph.hpp"
+#include "fiber_group.hpp"
+#if defined(__cpp_impl_coroutine)
+#include "fiber_coro.hpp"
+#endif
+#include "fiber_asio.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#if !defined(_WIN32)
+#include "fiber_io.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include <boost/fiber/channel_op_status.hpp>
 
+#include <array>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <iterator>
+#include <future>
+#include <thread>
+
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
 
 using boost::fibers::future;
 
+// 分别以 shared_work 与 work_stealing 调度算法按 options 创建池并执行 fn(pool), 之后等待池中的任务完成
+template< typename Fn >
+void with_each_scheduling(fiber_pool::pool_options options, Fn&& fn)
+{
+    for (auto scheduling : { fiber_pool::shared_work, fiber_pool::work_stealing })
+    {
+        INFO((scheduling == fiber_pool::shared_work ? "shared_work" : "work_stealing"));
+        options.scheduling = scheduling;
+
+        fiber_pool::pool pool{ options };
+        fn(pool);
+        pool.shutdown(true);
+    }
+}
+
 
 TEST_CASE("No of threads and fibers", "[default-pool]")
 {
@@ -148,6 +191,1563 @@ TEST_CASE("Throw exception", "[default-pool]")
     CHECK(get_fiber_pool().fiber_count() == 0);
 }
 
+TEST_CASE("Yielding fibers", "[pool]")
+{
+    // 反复让出的纤程不能使之后投递的纤程饥饿
+    fiber_pool::pool_options options;
+    options.threads = 1;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::atomic<bool> flag{ false };
+        std::atomic<size_t> done{ 0 };
+        for (size_t i = 0; i < 2; ++i)
+        {
+            pool.post([&flag, &done]() {
+                while (!flag)
+                    boost::this_fiber::yield();
+                ++done;
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        pool.post([&flag]() { flag = true; });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        while (done != 2 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        CHECK(done == 2);
+
+        flag = true;
+    });
+}
+
+TEST_CASE("Work stealing", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 4;
+    options.scheduling = fiber_pool::work_stealing;
+
+    fiber_pool::pool pool{ options };
+
+    // 在池内投递的纤程进入当前线程的本地队列, 阻塞当前线程后只能由其他线程窃取执行
+    std::mutex mtx;
+    std::set<boost::thread::id> threads;
+    auto f = pool.async([&pool, &mtx, &threads]() {
+        std::vector<future<size_t>> ofs;
+        for (size_t i = 0; i < 32; ++i)
+        {
+            ofs.emplace_back(pool.async([&mtx, &threads](size_t n) {
+                {
+                    std::lock_guard<std::mutex> lk{ mtx };
+                    threads.insert(boost::this_thread::get_id());
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                return n;
+            }, i));
+        }
+
+        size_t sum = 0;
+        for (auto&& of : ofs)
+            sum += of.get();
+        return sum;
+    });
+
+    CHECK(f.get() == 496);
+    CHECK(threads.size() > 1);
+
+    pool.shutdown(true);
+}
+
+TEST_CASE("Concurrent producers", "[pool]")
+{
+    // 多个外部线程同时投递, 纤程均经由共享的注入队列(启用 FIBERPOOL_ENABLE_LOCKFREE_QUEUE 时为无锁队列)
+    fiber_pool::pool_options options;
+    options.threads = 2;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::atomic<size_t> count{ 0 };
+        std::vector<std::thread> producers;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            producers.emplace_back([&pool, &count]() {
+                for (size_t n = 0; n < 5000; ++n)
+                    pool.post([&count]() { ++count; });
+            });
+        }
+
+        for (auto& producer : producers)
+            producer.join();
+
+        pool.shutdown(true);
+        CHECK(count == 20000);
+    });
+}
+
+TEST_CASE("Idle wakeup", "[pool]")
+{
+    // 工作线程立即挂起, 之后的每次投递都需要唤醒一个挂起的线程
+    fiber_pool::pool_options options;
+    options.threads = 4;
+    options.spin_count = 0;
+    options.yield_count = 0;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        auto wait_idle = [&pool]() {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (pool.idle_count() != 4 && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return pool.idle_count() == 4;
+        };
+
+        CHECK(wait_idle());
+
+        size_t sum = 0;
+        for (size_t i = 0; i < 100; ++i)
+        {
+            sum += pool.async([](size_t n) { return n; }, i).get();
+            if (i % 10 == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        CHECK(sum == 4950);
+
+        CHECK(wait_idle());
+    });
+}
+
+TEST_CASE("Idle spinning", "[pool]")
+{
+    // 无论自旋多久, 空闲的工作线程最终都会挂起, 挂起前后投递的纤程均被执行
+    for (auto counts : { std::make_pair(0, 0), std::make_pair(256, 4), std::make_pair(100000, 64) })
+    {
+        fiber_pool::pool_options options;
+        options.threads = 2;
+        options.spin_count = counts.first;
+        options.yield_count = counts.second;
+
+        fiber_pool::pool pool{ options };
+
+        size_t sum = 0;
+        for (size_t i = 0; i < 100; ++i)
+            sum += pool.async([](size_t n) { return n; }, i).get();
+        CHECK(sum == 4950);
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (pool.idle_count() != 2 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        CHECK(pool.idle_count() == 2);
+
+        CHECK(pool.async([]() { return true; }).get());
+
+        pool.shutdown(true);
+    }
+}
+
+TEST_CASE("Priorities", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 1;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        // 阻塞唯一的工作线程, 使所有纤程同时排队
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+        pool.post([released]() { released.wait(); });
+
+        std::vector<fiber_pool::priority_t> order;
+        std::vector<future<void>> ofs;
+        for (auto priority : { fiber_pool::low_priority, fiber_pool::high_priority, fiber_pool::normal_priority,
+            fiber_pool::critical_priority, fiber_pool::low_priority, fiber_pool::high_priority })
+        {
+            ofs.emplace_back(pool.async(priority,
+                [&order, priority]() { order.push_back(priority); }));
+        }
+
+        release.set_value();
+        for (auto&& of : ofs)
+            of.wait();
+
+        CHECK(order == std::vector<fiber_pool::priority_t>{ fiber_pool::critical_priority, fiber_pool::high_priority,
+            fiber_pool::high_priority, fiber_pool::normal_priority, fiber_pool::low_priority, fiber_pool::low_priority });
+    });
+}
+
+TEST_CASE("Fiber count", "[pool]")
+{
+    // 纤程在一个线程上计入, 在另一个线程上结束, 各分片之和仍然准确
+    fiber_pool::pool_options options;
+    options.threads = 4;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::vector<std::thread> producers;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            producers.emplace_back([&pool]() {
+                std::vector<future<size_t>> ofs;
+                for (size_t n = 0; n < 500; ++n)
+                {
+                    ofs.emplace_back(pool.async([&pool](size_t v) {
+                        return pool.async([v]() { return v; }).get();
+                    }, n));
+                }
+
+                for (auto&& of : ofs)
+                    of.wait();
+            });
+        }
+
+        for (auto& producer : producers)
+            producer.join();
+
+        CHECK(pool.fiber_count() == 0);
+
+        pool.shutdown(true);
+        CHECK(pool.fiber_count() == 0);
+    });
+}
+
+TEST_CASE("Interruption", "[pool]")
+{
+    CHECK_FALSE(boost::this_fiber::interrupted());
+
+    fiber_pool::pool_options options;
+    options.threads = 1;
+
+    fiber_pool::pool a{ options };
+    fiber_pool::pool b{ options };
+
+    CHECK_FALSE(a.async([]() { return boost::this_fiber::interrupted(); }).get());
+
+    std::promise<void> started;
+    std::atomic<bool> interrupted{ false };
+    a.post([&started, &interrupted]() {
+        started.set_value();
+        while (!boost::this_fiber::interrupted())
+            boost::this_fiber::sleep_for(std::chrono::milliseconds(1));
+        interrupted = true;
+    });
+    started.get_future().wait();
+
+    // 只有纤程所属的池被清理时才中断
+    b.shutdown(false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_FALSE(interrupted);
+
+    a.shutdown(false);
+    CHECK(interrupted);
+}
+
+TEST_CASE("Independent pools", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 1;
+
+    fiber_pool::pool cpu_pool{ options };
+
+    options.scheduling = fiber_pool::work_stealing;
+    fiber_pool::pool io_pool{ options };
+
+    SECTION("A blocked pool does not delay another pool")
+    {
+        // 阻塞cpu_pool唯一的工作线程
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+        cpu_pool.post([released]() { released.wait(); });
+
+        auto f = io_pool.async([]() { return 42; });
+        CHECK(f.get() == 42);
+
+        release.set_value();
+        CHECK(cpu_pool.async([]() { return true; }).get());
+    }
+
+    SECTION("Fibers posted from another pool run on the target pool")
+    {
+        auto io_thread = io_pool.async([]() {
+            return boost::this_thread::get_id(); }).get();
+
+        auto f = cpu_pool.async([&io_pool]() {
+            return io_pool.async([]() {
+                return boost::this_thread::get_id(); }).get();
+        });
+
+        CHECK(f.get() == io_thread);
+    }
+
+    SECTION("Queues, counts and shutdown are per pool")
+    {
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+        cpu_pool.post([released]() { released.wait(); });
+
+        // cpu_pool中排队的纤程既不计入io_pool, 也不会被io_pool执行
+        std::atomic<size_t> ran{ 0 };
+        std::atomic<size_t> interrupted{ 0 };
+        std::vector<future<void>> ofs;
+        for (size_t i = 0; i < 10; ++i)
+        {
+            ofs.emplace_back(cpu_pool.async([&ran, &interrupted]() {
+                ++ran;
+                if (boost::this_fiber::interrupted())
+                    ++interrupted;
+            }));
+        }
+
+        CHECK(cpu_pool.fiber_count() == 11);
+        CHECK(io_pool.fiber_count() == 0);
+        CHECK(io_pool.async([]() { return 42; }).get() == 42);
+        CHECK(ran == 0);
+
+        // 关闭io_pool不影响cpu_pool中排队的纤程
+        io_pool.shutdown(true);
+        CHECK(io_pool.state() == fiber_pool::pool::stoped);
+        CHECK(cpu_pool.state() == fiber_pool::pool::running);
+        CHECK(cpu_pool.fiber_count() == 11);
+
+        release.set_value();
+        for (auto&& of : ofs)
+            of.wait();
+
+        CHECK(ran == 10);
+        CHECK(interrupted == 0);
+        CHECK(cpu_pool.async([]() { return true; }).get());
+    }
+
+    cpu_pool.shutdown(true);
+    io_pool.shutdown(true);
+
+    CHECK(cpu_pool.state() == fiber_pool::pool::stoped);
+    CHECK(io_pool.state() == fiber_pool::pool::stoped);
+}
+
+TEST_CASE("Stack allocator", "[pool]")
+{
+    for (auto allocator : { fiber_pool::fixedsize_stack,
+        fiber_pool::protected_fixedsize_stack, fiber_pool::pooled_fixedsize_stack })
+    {
+        fiber_pool::pool_options options;
+        options.threads = 2;
+        options.stack_allocator = allocator;
+        options.stack_size = 64 * 1024;
+
+        fiber_pool::pool pool{ options };
+
+        // 多轮投递, 使后面的纤程复用前面释放的栈
+        size_t sum = 0;
+        for (size_t round = 0; round < 3; ++round)
+        {
+            std::vector<future<size_t>> ofs;
+            for (size_t i = 0; i < 100; ++i)
+                ofs.emplace_back(pool.async([](size_t n) { return n; }, i));
+
+            for (auto&& of : ofs)
+                sum += of.get();
+        }
+
+        CHECK(sum == 3 * 4950);
+
+        pool.shutdown(true);
+    }
+
+    // 纤程的句柄在池析构之后才释放其上下文与栈
+    for (auto allocator : { fiber_pool::fixedsize_stack,
+        fiber_pool::protected_fixedsize_stack, fiber_pool::pooled_fixedsize_stack })
+    {
+        fiber_pool::pool_options options;
+        options.threads = 1;
+        options.stack_allocator = allocator;
+
+        fiber_pool::fiber f;
+        {
+            fiber_pool::pool pool{ options };
+            f = pool.post([]() {});
+            pool.shutdown(true);
+        }
+
+        CHECK(f.finshed());
+        f = fiber_pool::fiber{};
+        CHECK_FALSE(f.joinable());
+    }
+}
+
+TEST_CASE("Affinity", "[pool]")
+{
+    for (auto affinity : { fiber_pool::numa_affinity, fiber_pool::core_affinity })
+    {
+        fiber_pool::pool_options options;
+        options.threads = 4;
+        options.affinity = affinity;
+
+        with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+            // 从池外以及池内的纤程中投递, 纤程可能分布在不同节点的队列中
+            std::vector<future<size_t>> ofs;
+            for (size_t i = 0; i < 100; ++i)
+            {
+                ofs.emplace_back(pool.async([&pool](size_t n) {
+                    return pool.async([](size_t m) { return m; }, n).get();
+                }, i));
+            }
+
+            size_t sum = 0;
+            for (auto&& of : ofs)
+                sum += of.get();
+
+            CHECK(sum == 4950);
+        });
+    }
+}
+
+TEST_CASE("Elastic workers", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 1;
+    options.max_threads = 4;
+    options.idle_timeout = 50;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        CHECK(pool.thread_count() == 1);
+
+        // 唯一的常驻线程阻塞在系统调用中, 池扩展出新的线程执行排队的纤程
+        std::atomic<bool> release{ false };
+        auto blocker = pool.async([&release]() {
+            while (!release)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+
+        auto f = pool.async([]() { return 42; });
+        CHECK(f.get() == 42);
+        CHECK(pool.thread_count() > 1);
+
+        release = true;
+        blocker.get();
+
+        // 扩展出的线程空闲超时后退出
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (pool.thread_count() > 1 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        CHECK(pool.thread_count() == 1);
+    });
+}
+
+TEST_CASE("Retiring workers", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 1;
+    options.max_threads = 2;
+    options.idle_timeout = 50;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (pool.idle_count() != 1 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        std::atomic<bool> blocked{ false };
+        std::atomic<bool> release{ false };
+        auto blocker = pool.async([&blocked, &release]() {
+            blocked = true;
+            while (!release)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+
+        while (!blocked)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        // 唤醒常驻线程的同时可能扩展出新的线程并抢先接手了阻塞的纤程, 此时附着的纤程将在常驻线程上运行
+        if (pool.thread_count() != 1)
+        {
+            release = true;
+            blocker.get();
+            return;
+        }
+
+        // 挂起在boost同步原语上的纤程附着于扩展出的线程, 该线程超时后也不退出
+        boost::fibers::promise<int> promise;
+        auto waiting = promise.get_future();
+        std::atomic<bool> started{ false };
+        auto f = pool.async([&waiting, &started]() {
+            started = true;
+            return waiting.get();
+        });
+
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!started && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(started);
+        CHECK(pool.thread_count() == 2);
+
+        release = true;
+        blocker.get();
+
+        // 附着的纤程结束之前既不退出也不空转
+        std::clock_t cpu = std::clock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        CHECK(pool.thread_count() == 2);
+        CHECK(double(std::clock() - cpu) / CLOCKS_PER_SEC < 0.15);
+
+        promise.set_value(42);
+        CHECK(f.get() == 42);
+
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (pool.thread_count() > 1 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        CHECK(pool.thread_count() == 1);
+    });
+}
+
+TEST_CASE("Blocking regions", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 1;
+    options.max_threads = 2;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        // 阻塞区域内排队的纤程由补充的线程执行
+        auto f = pool.async([&pool]() {
+            std::promise<int> promise;
+            auto result = promise.get_future();
+            pool.post([&promise]() { promise.set_value(42); });
+
+            return fiber_pool::blocking([&result]() {
+                return result.wait_for(std::chrono::seconds(10)) == std::future_status::ready ? result.get() : 0;
+            });
+        });
+
+        CHECK(f.get() == 42);
+
+#if !defined(_WIN32)
+        // 未启用反应器时描述符保持阻塞, 阻塞的读同样视为阻塞区域
+        int sv[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+        auto read = pool.async([&pool, sv]() {
+            pool.post([fd = sv[1]]() { fiber_pool::io::async_write(fd, "y", 1); });
+
+            char c = 0;
+            fiber_pool::io::async_read(sv[0], &c, 1);
+            return c;
+        });
+
+        // 写纤程未被接手时由当前线程解除阻塞, 避免测试挂起
+        if (read.wait_for(std::chrono::seconds(5)) != boost::fibers::future_status::ready)
+            CHECK(::write(sv[1], "z", 1) == 1);
+        CHECK(read.get() == 'y');
+
+        ::close(sv[0]);
+        ::close(sv[1]);
+#endif
+    });
+
+    // 非工作线程中直接执行
+    CHECK(fiber_pool::blocking([]() { return 7; }) == 7);
+}
+
+TEST_CASE("Timers", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 2;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        // 跨越时间轮各层的睡眠时长, 唤醒不早于到期时间
+        std::atomic<size_t> early{ 0 };
+        std::vector<future<void>> fs;
+        for (int i = 0; i < 2000; ++i)
+        {
+            auto duration = std::chrono::milliseconds(i % 3 == 0 ? 64 * (i % 5) + i % 7 : i % 50);
+            fs.push_back(pool.async([&early, duration]() {
+                auto start = std::chrono::steady_clock::now();
+                fiber_pool::this_fiber::sleep_for(duration);
+                if (std::chrono::steady_clock::now() - start < duration)
+                    ++early;
+            }));
+        }
+
+        // 绑定线程的纤程同样可以睡眠
+        auto bound = pool.async([]() {
+            boost::this_fiber::bind_thread();
+            auto id = std::this_thread::get_id();
+            for (int i = 0; i < 10; ++i)
+                fiber_pool::this_fiber::sleep_for(std::chrono::milliseconds(2));
+            return id == std::this_thread::get_id();
+        });
+
+        for (auto& f : fs)
+            f.get();
+        CHECK(early == 0);
+        CHECK(bound.get());
+    });
+
+    // 非工作线程中退化为 boost::this_fiber::sleep_for()
+    auto start = std::chrono::steady_clock::now();
+    fiber_pool::this_fiber::sleep_for(std::chrono::milliseconds(5));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+}
+
+#if !defined(_WIN32)
+TEST_CASE("Reactor", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 2;
+    options.reactor = true;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        // 每对套接字上一个回显纤程, 一个客户纤程, 读总是先于写挂起
+        const int pairs = 100;
+        std::vector<int> fds;
+        std::vector<future<bool>> fs;
+        for (int i = 0; i < pairs; ++i)
+        {
+            int sv[2];
+            REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+            fds.push_back(sv[0]);
+            fds.push_back(sv[1]);
+
+            pool.post([fd = sv[1]]() {
+                char buf[256];
+                for (;;)
+                {
+                    auto n = fiber_pool::io::async_read(fd, buf, sizeof(buf));
+                    if (n == 0)
+                        break;
+                    fiber_pool::io::async_write(fd, buf, n);
+                }
+            });
+
+            fs.push_back(pool.async([fd = sv[0], i]() {
+                std::string sent(1000 + i, char('a' + i % 26));
+                std::string received;
+                fiber_pool::io::async_write(fd, sent.data(), sent.size());
+                while (received.size() < sent.size())
+                {
+                    char buf[128];
+                    auto n = fiber_pool::io::async_read(fd, buf, sizeof(buf));
+                    if (n == 0)
+                        break;
+                    received.append(buf, n);
+                }
+                ::shutdown(fd, SHUT_WR);
+                return received == sent;
+            }));
+        }
+
+        size_t ok = 0;
+        for (auto& f : fs)
+            ok += f.get();
+        CHECK(ok == pairs);
+
+        // 同一描述符上已有读等待者, 清理时等待者以ECANCELED被唤醒
+        int sv[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        fds.push_back(sv[0]);
+        fds.push_back(sv[1]);
+
+        auto pending = pool.async([fd = sv[0]]() {
+            char c;
+            try {
+                fiber_pool::io::async_read(fd, &c, 1);
+            }
+            catch (std::system_error const& e) {
+                return e.code().value();
+            }
+            return 0;
+        });
+        auto busy = pool.async([fd = sv[0]]() {
+            fiber_pool::this_fiber::sleep_for(std::chrono::milliseconds(20));
+            char c;
+            try {
+                fiber_pool::io::async_read(fd, &c, 1);
+            }
+            catch (std::system_error const& e) {
+                return e.code().value();
+            }
+            return 0;
+        });
+        CHECK(busy.get() == EBUSY);
+
+        pool.shutdown();
+        CHECK(pending.get() == ECANCELED);
+
+        for (int fd : fds)
+            ::close(fd);
+    });
+
+    // 非工作线程中以poll()阻塞等待
+    int sv[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    std::thread writer([fd = sv[1]]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        fiber_pool::io::async_write(fd, "x", 1);
+    });
+    char c = 0;
+    ::fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    CHECK(fiber_pool::io::async_read(sv[0], &c, 1) == 1);
+    CHECK(c == 'x');
+    writer.join();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+TEST_CASE("io_uring", "[pool]")
+{
+    // 完成事件直接由 io_uring_enter() 收割, 或者经由反应器的eventfd通知
+    for (bool reactor : { false, true })
+    {
+        fiber_pool::pool_options options;
+        options.threads = 2;
+        options.uring = true;
+        options.reactor = reactor;
+
+        with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+            char path[] = "/tmp/fiber_pool_XXXXXX";
+            int file = ::mkstemp(path);
+            REQUIRE(file >= 0);
+            ::unlink(path);
+
+            // 各纤程写入不同的区间, 再交错读回
+            const int blocks = 200;
+            const size_t block_size = 4096;
+            std::vector<future<void>> writes;
+            for (int i = 0; i < blocks; ++i)
+            {
+                writes.push_back(pool.async([file, i]() {
+                    std::string data(block_size, char('a' + i % 26));
+                    fiber_pool::io::write_at(file, data.data(), data.size(), uint64_t(i) * block_size);
+                }));
+            }
+            for (auto& f : writes)
+                f.get();
+
+            std::vector<future<bool>> reads;
+            for (int i = blocks - 1; i >= 0; --i)
+            {
+                reads.push_back(pool.async([file, i]() {
+                    std::string data(block_size, '\0');
+                    size_t n = fiber_pool::io::read_at(file, &data[0], data.size(), uint64_t(i) * block_size);
+                    return n == block_size && data == std::string(block_size, char('a' + i % 26));
+                }));
+            }
+            size_t ok = 0;
+            for (auto& f : reads)
+                ok += f.get();
+            CHECK(ok == blocks);
+
+            // 文件末尾
+            auto eof = pool.async([file]() {
+                char c;
+                return fiber_pool::io::read_at(file, &c, 1, uint64_t(blocks) * block_size);
+            });
+            CHECK(eof.get() == 0);
+
+            // 无效的描述符以异常报告
+            auto bad = pool.async([]() {
+                char c;
+                try {
+                    fiber_pool::io::read_at(-1, &c, 1, 0);
+                }
+                catch (std::system_error const& e) {
+                    return e.code().value();
+                }
+                return 0;
+            });
+            CHECK(bad.get() == EBADF);
+
+            // recv()/send() 回显
+            std::vector<int> fds;
+            std::vector<future<bool>> fs;
+            for (int i = 0; i < 50; ++i)
+            {
+                int sv[2];
+                REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+                fds.push_back(sv[0]);
+                fds.push_back(sv[1]);
+
+                pool.post([fd = sv[1]]() {
+                    char buf[256];
+                    size_t n;
+                    while ((n = fiber_pool::io::recv(fd, buf, sizeof(buf))) > 0)
+                    {
+                        for (size_t sent = 0; sent < n; )
+                            sent += fiber_pool::io::send(fd, buf + sent, n - sent);
+                    }
+                });
+
+                fs.push_back(pool.async([fd = sv[0], i]() {
+                    std::string sent(500 + i, char('A' + i % 26));
+                    std::string received;
+                    for (size_t done = 0; done < sent.size(); )
+                        done += fiber_pool::io::send(fd, sent.data() + done, sent.size() - done);
+                    while (received.size() < sent.size())
+                    {
+                        char buf[128];
+                        size_t n = fiber_pool::io::recv(fd, buf, sizeof(buf));
+                        if (n == 0)
+                            break;
+                        received.append(buf, n);
+                    }
+                    ::shutdown(fd, SHUT_WR);
+                    return received == sent;
+                }));
+            }
+            ok = 0;
+            for (auto& f : fs)
+                ok += f.get();
+            CHECK(ok == fs.size());
+
+            pool.shutdown(true);
+            for (int fd : fds)
+                ::close(fd);
+
+            // 非工作线程中同步调用
+            char c = 0;
+            CHECK(fiber_pool::io::read_at(file, &c, 1, block_size) == 1);
+            CHECK(c == 'b');
+            ::close(file);
+        });
+    }
+}
+#endif
+
+TEST_CASE("Asio executor", "[pool]")
+{
+    namespace asio = boost::asio;
+
+    fiber_pool::pool pool{ 2 };
+    fiber_pool::pool_executor ex{ pool };
+
+    static_assert(asio::execution::is_executor< fiber_pool::pool_executor >::value, "");
+    CHECK(&asio::query(ex, asio::execution::context) == &pool);
+    CHECK(!ex.running_in_this_thread());
+
+    // post() 总是投递到新的纤程, dispatch() 在池的工作线程上就地调用
+    boost::fibers::promise<bool> posted;
+    asio::post(ex, [&posted, &ex]() { posted.set_value(ex.running_in_this_thread()); });
+    CHECK(posted.get_future().get());
+
+    auto inline_run = pool.async([&ex]() {
+        auto self = boost::this_fiber::get_id();
+        bool inlined = false;
+        asio::dispatch(ex, [&inlined, self]() { inlined = boost::this_fiber::get_id() == self; });
+
+        boost::fibers::promise<bool> deferred;
+        asio::post(ex, [&deferred, self]() { deferred.set_value(boost::this_fiber::get_id() != self); });
+        return inlined && deferred.get_future().get();
+    });
+    CHECK(inline_run.get());
+
+    // 未完成的工作计入池的未决任务
+    {
+        auto work = asio::prefer(ex, asio::execution::outstanding_work.tracked);
+        CHECK(asio::query(work, asio::execution::outstanding_work) == asio::execution::outstanding_work.tracked);
+        CHECK(pool.fiber_count() >= 1);
+    }
+
+    asio::io_context io;
+    auto guard = asio::make_work_guard(io);
+    std::thread io_thread([&io]() { io.run(); });
+
+    // 绑定执行器的处理器直接在池中执行
+    {
+        boost::fibers::promise<bool> done;
+        asio::steady_timer timer{ io, std::chrono::milliseconds(2) };
+        timer.async_wait(asio::bind_executor(ex, [&done, &ex](boost::system::error_code const& ec) {
+            done.set_value(!ec && ex.running_in_this_thread());
+        }));
+        CHECK(done.get_future().get());
+    }
+
+    // 以 fiber_pool::yield 挂起纤程等待异步操作
+    auto waited = pool.async([&io]() {
+        asio::steady_timer timer{ io, std::chrono::milliseconds(5) };
+        auto start = std::chrono::steady_clock::now();
+        timer.async_wait(fiber_pool::yield);
+        return std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5);
+    });
+    CHECK(waited.get());
+
+    // 在io_context的线程中反复尝试, 直到取消了已登记的等待
+    std::function<void(asio::steady_timer&)> cancel = [&io, &cancel](asio::steady_timer& timer) {
+        asio::post(io, [&timer, &cancel]() {
+            if (timer.cancel() == 0)
+                cancel(timer);
+        });
+    };
+
+    auto aborted = pool.async([&io, &cancel]() {
+        asio::steady_timer timer{ io, std::chrono::hours(1) };
+        cancel(timer);
+        boost::system::error_code ec;
+        timer.async_wait(fiber_pool::yield[ec]);
+        return ec == asio::error::operation_aborted;
+    });
+    CHECK(aborted.get());
+
+    auto thrown = pool.async([&io, &cancel]() {
+        asio::steady_timer timer{ io, std::chrono::hours(1) };
+        cancel(timer);
+        try {
+            timer.async_wait(fiber_pool::yield);
+        }
+        catch (boost::system::system_error const& e) {
+            return e.code() == asio::error::operation_aborted;
+        }
+        return false;
+    });
+    CHECK(thrown.get());
+
+    // 带返回值的自定义异步操作
+    auto sum = pool.async([&io]() {
+        return asio::async_initiate<fiber_pool::yield_t const&, void(boost::system::error_code, int)>(
+            [&io](auto handler, int a, int b) {
+                asio::post(io, [h = std::move(handler), a, b]() mutable { h(boost::system::error_code(), a + b); });
+            }, fiber_pool::yield, 20, 22);
+    });
+    CHECK(sum.get() == 42);
+
+    guard.reset();
+    io_thread.join();
+    pool.shutdown(true);
+}
+
+TEST_CASE("Fiber handle", "[pool]")
+{
+    fiber_pool::pool pool{ 1 };
+
+    SECTION("Small and large closures")
+    {
+        std::array<size_t, 64> large;
+        for (size_t i = 0; i < large.size(); ++i)
+            large[i] = i;
+
+        auto small = pool.async([](size_t n) { return n; }, size_t(2016));
+        auto big = pool.async([large]() {
+            size_t r = 0;
+            for (auto v : large)
+                r += v;
+            return r;
+        });
+
+        CHECK(small.get() == 2016);
+        CHECK(big.get() == 2016);
+    }
+
+    SECTION("Join through a copy")
+    {
+        fiber_pool::fiber f = pool.post([]() {
+            boost::this_fiber::sleep_for(std::chrono::milliseconds(10)); });
+        fiber_pool::fiber g = f;
+
+        CHECK(g.get_id() == f.get_id());
+
+        f.join();
+        CHECK(!f.joinable());
+        CHECK(g.joinable());
+        CHECK(g.finshed());
+    }
+
+    SECTION("Interrupt when the last handle is destroyed")
+    {
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+        pool.post([released]() { released.wait(); });
+
+        bool ran = false;
+        {
+            fiber_pool::fiber f = pool.post([&ran]() { ran = true; });
+            fiber_pool::fiber g = f;
+            g.interrupt_on_destruct();
+        }
+
+        release.set_value();
+        pool.async([]() {}).wait();
+
+        CHECK(!ran);
+    }
+
+    pool.shutdown(true);
+}
+
+TEST_CASE("Bulk submission", "[pool]")
+{
+    fiber_pool::pool_options options;
+    options.threads = 2;
+
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::vector<size_t> values(1000);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = i;
+
+        // 结果按元素的顺序返回
+        auto ofs = pool.async_bulk(values.begin(), values.end(), [](size_t n) { return n * 2; });
+        REQUIRE(ofs.size() == values.size());
+
+        bool ordered = true;
+        for (size_t i = 0; i < ofs.size(); ++i)
+            ordered = ordered && ofs[i].get() == i * 2;
+        CHECK(ordered);
+
+        // 在池内的纤程中批量投递
+        std::atomic<size_t> sum{ 0 };
+        auto f = pool.async([&pool, &values, &sum]() {
+            auto done = std::make_shared<boost::fibers::promise<void>>();
+            auto remaining = std::make_shared<std::atomic<size_t>>(values.size());
+            auto finished = done->get_future();
+
+            pool.post_bulk(values.begin(), values.end(), [&sum, done, remaining](size_t n) {
+                sum += n;
+                if (--*remaining == 0)
+                    done->set_value();
+            });
+
+            finished.wait();
+        });
+
+        f.wait();
+        CHECK(sum == 499500);
+    });
+}
+
+TEST_CASE("Bounded queue", "[pool]")
+{
+    // 占住唯一的工作线程, 之后投递的任务均停留在就绪队列中
+    auto occupy = [](fiber_pool::pool& pool, std::shared_future<void> gate) {
+        std::promise<void> entered;
+        pool.post([&entered, gate]() {
+            entered.set_value();
+            gate.wait();
+        });
+        entered.get_future().wait();
+    };
+
+    fiber_pool::pool_options options;
+    options.threads = 1;
+    options.queue_capacity = 4;
+
+    // 拒绝
+    options.overflow = fiber_pool::overflow_reject;
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::promise<void> gate;
+        occupy(pool, gate.get_future().share());
+
+        std::atomic<size_t> count{ 0 };
+        for (size_t i = 0; i < 4; ++i)
+            CHECK(pool.try_post([&count]() { ++count; }));
+
+        CHECK(pool.queued_count() == 4);
+        CHECK_FALSE(pool.try_post([&count]() { ++count; }));
+        CHECK_THROWS_AS(pool.post([&count]() { ++count; }), std::runtime_error);
+
+        // Asio的处理器不受容量限制
+        boost::asio::post(fiber_pool::pool_executor{ pool }, [&count]() { ++count; });
+
+        gate.set_value();
+        pool.shutdown(true);
+        CHECK(count == 5);
+        CHECK(pool.queued_count() == 0);
+    });
+
+    // 丢弃最早的任务
+    options.overflow = fiber_pool::overflow_drop_oldest;
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::promise<void> gate;
+        occupy(pool, gate.get_future().share());
+
+        std::vector<fiber_pool::future<size_t>> fs;
+        for (size_t i = 0; i < 8; ++i)
+            fs.push_back(pool.async([i]() { return i; }));
+
+        CHECK(pool.queued_count() == 4);
+
+        // 被丢弃的纤程尚未结束, 其数量也达到容量时等待而不是继续创建纤程
+        std::atomic<bool> posted{ false };
+        fiber_pool::future<size_t> last;
+        std::thread poster([&]() {
+            last = pool.async([]() { return size_t(8); });
+            posted = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_FALSE(posted);
+        CHECK(pool.fiber_count() == 9);
+
+        gate.set_value();
+        poster.join();
+        CHECK(posted);
+
+        for (size_t i = 0; i < 4; ++i)
+            CHECK_THROWS_AS(fs[i].get(), boost::fibers::future_error);
+        CHECK(last.get() == 8);
+    });
+
+    // 阻塞
+    options.overflow = fiber_pool::overflow_block;
+    with_each_scheduling(options, [&](fiber_pool::pool& pool) {
+        std::promise<void> gate;
+        occupy(pool, gate.get_future().share());
+
+        std::atomic<size_t> count{ 0 };
+        for (size_t i = 0; i < 4; ++i)
+            pool.post([&count]() { ++count; });
+
+        std::atomic<bool> posted{ false };
+        std::thread poster([&]() {
+            pool.post([&count]() { ++count; });
+            posted = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_FALSE(posted);
+        CHECK(pool.queued_count() == 4);
+
+        gate.set_value();
+        poster.join();
+        CHECK(posted);
+
+        // 单遍迭代器的批量投递逐个登记, 已满时同样阻塞
+        std::promise<void> gate2;
+        occupy(pool, gate2.get_future().share());
+
+        std::istringstream input{ "1 2 3 4 5 6" };
+        std::atomic<size_t> total{ 0 };
+        std::atomic<bool> bulk_posted{ false };
+        std::thread bulk_poster([&]() {
+            pool.post_bulk(std::istream_iterator<size_t>(input), std::istream_iterator<size_t>(),
+                [&total](size_t n) { total += n; });
+            bulk_posted = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_FALSE(bulk_posted);
+        CHECK(pool.queued_count() == 4);
+
+        gate2.set_value();
+        bulk_poster.join();
+        CHECK(bulk_posted);
+
+        // 就绪队列为空时超过容量的批量投递同样允许, 在池内的纤程中投递时只挂起该纤程
+        std::vector<size_t> values(100, 1);
+        std::atomic<size_t> sum{ 0 };
+        pool.async([&pool, &values, &sum]() {
+            pool.post_bulk(values.begin(), values.end(), [&sum](size_t n) { sum += n; });
+            for (size_t i = 0; i < 100; ++i)
+                pool.post([&sum]() { ++sum; });
+        }).wait();
+
+        pool.shutdown(true);
+        CHECK(count == 5);
+        CHECK(total == 21);
+        CHECK(sum == 200);
+    });
+}
+
+TEST_CASE("Parallel algorithms", "[pool]")
+{
+    fiber_pool::pool pool{ 4 };
+
+    SECTION("Every index is visited once")
+    {
+        std::vector<std::atomic<int>> visits(10000);
+        fiber_pool::parallel_for(pool, size_t(0), visits.size(), 64,
+            [&visits](size_t i) { ++visits[i]; });
+
+        bool once = true;
+        for (auto& v : visits)
+            once = once && v == 1;
+        CHECK(once);
+    }
+
+    SECTION("Reduce over iterators")
+    {
+        std::vector<size_t> values(100000);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = i;
+
+        auto sum = fiber_pool::parallel_reduce(pool, values.begin(), values.end(), 1000, size_t(0),
+            [](std::vector<size_t>::iterator first, std::vector<size_t>::iterator last, size_t init) {
+                for (; first != last; ++first)
+                    init += *first;
+                return init;
+            },
+            [](size_t a, size_t b) { return a + b; });
+
+        CHECK(sum == 4999950000);
+    }
+
+    SECTION("Exceptions are rethrown to the caller")
+    {
+        CHECK_THROWS_AS(fiber_pool::parallel_for(pool, 0, 1000, 10, [](int i) {
+            if (i == 500)
+                throw std::runtime_error("some exception");
+        }), std::runtime_error);
+    }
+
+    SECTION("Nested in a fiber of a single thread pool")
+    {
+        fiber_pool::pool single{ 1 };
+
+        auto f = single.async([&single]() {
+            return fiber_pool::parallel_reduce(single, 0, 1000, 10, 0,
+                [](int first, int last, int init) { return init + (last - first); },
+                [](int a, int b) { return a + b; });
+        });
+
+        CHECK(f.get() == 1000);
+        single.shutdown(true);
+    }
+
+    SECTION("The caller finishes the work when the pool stops accepting helpers")
+    {
+        fiber_pool::pool closing{ 2 };
+
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+        std::atomic<size_t> visited{ 0 };
+        auto f = closing.async([&closing, released, &visited]() {
+            released.wait();
+            fiber_pool::parallel_for(closing, 0, 100, 1, [&visited](int) { ++visited; });
+        });
+
+        // 池转入waiting状态后, 辅助纤程的投递失败
+        std::thread stopper([&closing]() { closing.shutdown(true); });
+        while (closing.state() == fiber_pool::pool::running)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        release.set_value();
+
+        CHECK_THROWS_AS(f.get(), std::runtime_error);
+        CHECK(visited == 100);
+        stopper.join();
+    }
+
+    pool.shutdown(true);
+}
+
+TEST_CASE("Continuations", "[pool]")
+{
+    fiber_pool::pool pool{ 2 };
+
+    SECTION("Chain stages with then()")
+    {
+        auto f = pool.async([]() { return 20; })
+            .then([](fiber_pool::future<int> f) { return f.get() + 1; })
+            .then([](fiber_pool::future<int> f) { return f.get() * 2; });
+
+        CHECK(f.get() == 42);
+    }
+
+    SECTION("Exceptions flow to the continuation")
+    {
+        auto f = pool.async([]() -> int { throw std::runtime_error("some exception"); })
+            .then([](fiber_pool::future<int> f) {
+                try { f.get(); }
+                catch (std::runtime_error const&) { return true; }
+                return false;
+            });
+
+        CHECK(f.get());
+    }
+
+    SECTION("Combine with when_all and when_any")
+    {
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+
+        std::vector<fiber_pool::future<int>> ofs;
+        ofs.emplace_back(pool.async([released]() { released.wait(); return 1; }));
+        ofs.emplace_back(pool.async([]() { return 2; }));
+
+        auto any = fiber_pool::when_any(ofs.begin(), ofs.end()).get();
+        CHECK(any.index == 1);
+        CHECK(any.futures.size() == 2);
+
+        release.set_value();
+        auto all = fiber_pool::when_all(any.futures.begin(), any.futures.end())
+            .then([](fiber_pool::future<std::vector<fiber_pool::future<int>>> f) {
+                int sum = 0;
+                for (auto&& of : f.get())
+                    sum += of.get();
+                return sum;
+            });
+
+        CHECK(all.get() == 3);
+
+        // 有无效的future时不移动任何future
+        std::vector<fiber_pool::future<int>> invalid;
+        invalid.emplace_back(pool.async([]() { return 1; }));
+        invalid.emplace_back();
+        CHECK_THROWS_AS(fiber_pool::when_all(invalid.begin(), invalid.end()), boost::fibers::future_uninitialized);
+        CHECK_THROWS_AS(fiber_pool::when_any(invalid.begin(), invalid.end()), boost::fibers::future_uninitialized);
+        CHECK(invalid[0].valid());
+        CHECK(invalid[0].get() == 1);
+    }
+
+    SECTION("Continuations without an owning pool run inline")
+    {
+        // 空序列的组合没有所属的池, 后续操作在当前线程中执行
+        std::vector<fiber_pool::future<int>> empty;
+        auto caller = std::this_thread::get_id();
+
+        auto all = fiber_pool::when_all(empty.begin(), empty.end())
+            .then([](fiber_pool::future<std::vector<fiber_pool::future<int>>> f) {
+                return std::make_pair(std::this_thread::get_id(), f.get().size());
+            });
+        CHECK(all.wait_for(std::chrono::seconds(0)) == boost::fibers::future_status::ready);
+        CHECK(all.get() == std::make_pair(caller, size_t(0)));
+
+        auto any = fiber_pool::when_any(empty.begin(), empty.end())
+            .then([](auto f) { return f.get().index; })
+            .then([](fiber_pool::future<size_t> f) { return f.get() == size_t(-1); });
+        CHECK(any.wait_for(std::chrono::seconds(0)) == boost::fibers::future_status::ready);
+        CHECK(any.get());
+    }
+
+    SECTION("Shutdown waits for pending continuations")
+    {
+        std::atomic<int> stages{ 0 };
+        pool.async([]() { boost::this_fiber::sleep_for(std::chrono::milliseconds(20)); })
+            .then([&stages](fiber_pool::future<void>) { ++stages; })
+            .then([&stages](fiber_pool::future<void>) { ++stages; });
+
+        pool.shutdown(true);
+        CHECK(stages == 2);
+    }
+
+    pool.shutdown(true);
+}
+
+TEST_CASE("Task graph", "[pool]")
+{
+    fiber_pool::pool pool{ 2 };
+
+    SECTION("Successors run after all predecessors, repeatedly")
+    {
+        // a -> (b, c) -> d
+        std::atomic<int> order{ 0 };
+        std::array<int, 4> seen{};
+
+        fiber_pool::task_graph graph;
+        auto a = graph.emplace([&]() { seen[0] = ++order; });
+        auto b = graph.emplace([&]() { seen[1] = ++order; });
+        auto c = graph.emplace([&]() { seen[2] = ++order; });
+        auto d = graph.emplace([&]() { seen[3] = ++order; });
+        graph.precede(a, b);
+        graph.precede(a, c);
+        graph.precede(b, d);
+        graph.precede(c, d);
+
+        for (int round = 0; round < 3; ++round)
+        {
+            order = 0;
+            graph.run(pool);
+
+            CHECK(seen[0] == 1);
+            CHECK(seen[3] == 4);
+        }
+    }
+
+    SECTION("Exceptions and cycles are reported")
+    {
+        fiber_pool::task_graph graph;
+        std::atomic<bool> skipped{ true };
+        auto a = graph.emplace([]() { throw std::runtime_error("some exception"); });
+        auto b = graph.emplace([&skipped]() { skipped = false; });
+        graph.precede(a, b);
+
+        CHECK_THROWS_AS(graph.run(pool), std::runtime_error);
+        CHECK(skipped);
+
+        graph.precede(b, a);
+        CHECK_THROWS_AS(graph.run(pool), std::logic_error);
+    }
+
+    pool.shutdown(true);
+}
+
+TEST_CASE("Task group", "[pool]")
+{
+    fiber_pool::pool pool{ 2 };
+
+    SECTION("Wait for all children")
+    {
+        std::atomic<int> count{ 0 };
+        {
+            fiber_pool::task_group group{ pool };
+            for (int i = 0; i < 100; ++i)
+                group.spawn([&count]() { ++count; });
+
+            group.wait();
+            CHECK(count == 100);
+
+            // 等待之后可以继续使用, 析构时等待剩余的子任务
+            group.spawn([&count]() { ++count; });
+        }
+        CHECK(count == 101);
+    }
+
+    SECTION("Cancel interrupts running children and drops queued ones")
+    {
+        fiber_pool::task_group group{ pool };
+
+        std::atomic<int> interrupted{ 0 };
+        for (int i = 0; i < 2; ++i)
+        {
+            group.spawn([&interrupted]() {
+                while (!boost::this_fiber::interrupted())
+                    boost::this_fiber::sleep_for(std::chrono::milliseconds(1));
+                ++interrupted;
+            });
+        }
+
+        boost::this_fiber::sleep_for(std::chrono::milliseconds(20));
+        group.cancel();
+
+        std::atomic<bool> ran{ false };
+        group.spawn([&ran]() { ran = true; });
+        group.wait();
+
+        CHECK(interrupted == 2);
+        CHECK(!ran);
+    }
+
+    SECTION("Cancel interrupts children run by wait()")
+    {
+        // 阻塞唯一的工作线程, 子任务只能由 wait() 在调用者中执行
+        fiber_pool::pool single{ 1 };
+        std::promise<void> release;
+        std::shared_future<void> released{ release.get_future() };
+        single.post([released]() { released.wait(); });
+
+        auto run = [&single]() {
+            fiber_pool::task_group group{ single };
+            std::atomic<bool> started{ false };
+            group.spawn([&started]() {
+                started = true;
+                while (!boost::this_fiber::interrupted())
+                    boost::this_fiber::sleep_for(std::chrono::milliseconds(1));
+            });
+
+            std::thread canceller([&group, &started]() {
+                while (!started)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                group.cancel();
+            });
+
+            group.wait();
+            canceller.join();
+            return !boost::this_fiber::interrupted();
+        };
+
+        // 在外部线程与池内的纤程中等待, 之后调用者自身不再被视为取消
+        CHECK(run());
+        CHECK(pool.async(run).get());
+
+        release.set_value();
+        single.shutdown(true);
+    }
+
+    SECTION("Exceptions cancel the group and are rethrown")
+    {
+        fiber_pool::task_group group{ pool };
+        group.spawn([]() { throw std::runtime_error("some exception"); });
+
+        CHECK_THROWS_AS(group.wait(), std::runtime_error);
+        CHECK(!group.cancelled());
+    }
+
+    pool.shutdown(true);
+}
+
+#if defined(__cpp_impl_coroutine)
+namespace {
+
+fiber_pool::task<int> square(fiber_pool::pool& pool, int n)
+{
+    co_await pool.schedule();
+    co_return n * n;
+}
+
+fiber_pool::task<int> sum_of_squares(fiber_pool::pool& pool, int n)
+{
+    int sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += co_await square(pool, i);
+
+    // 等待纤程任务的future而不阻塞纤程
+    sum += co_await pool.async([]() { return 1000; });
+    co_return sum;
+}
+
+} // namespace
+
+TEST_CASE("Coroutines", "[pool]")
+{
+    fiber_pool::pool pool{ 2 };
+
+    SECTION("Tasks resume on the pool")
+    {
+        CHECK(fiber_pool::spawn(pool, sum_of_squares(pool, 10)).get() == 1285);
+    }
+
+    SECTION("Many concurrent tasks")
+    {
+        std::vector<fiber_pool::future<int>> ofs;
+        for (int i = 0; i < 10000; ++i)
+            ofs.emplace_back(fiber_pool::spawn(pool, square(pool, 3)));
+
+        int sum = 0;
+        for (auto&& of : ofs)
+            sum += of.get();
+        CHECK(sum == 90000);
+    }
+
+    pool.shutdown(true);
+}
+#endif
+
+TEST_CASE("Shutdown", "[pool]")
+{
+    SECTION("Drain completes as soon as the last task finishes")
+    {
+        fiber_pool::pool pool{ 2 };
+
+        typedef std::chrono::steady_clock clock;
+        std::atomic<int> finished{ 0 };
+        std::atomic<clock::rep> last{ 0 };
+        for (int i = 0; i < 4; ++i)
+        {
+            pool.post([&finished, &last]() {
+                boost::this_fiber::sleep_for(std::chrono::milliseconds(20));
+                clock::rep now = clock::now().time_since_epoch().count();
+                clock::rep prev = last.load();
+                while (prev < now && !last.compare_exchange_weak(prev, now));
+                ++finished;
+            });
+        }
+
+        CHECK(pool.shutdown_for(std::chrono::seconds(10)));
+        auto returned = clock::now();
+        CHECK(finished == 4);
+        CHECK(pool.state() == fiber_pool::pool::stoped);
+
+        // 由最后一个结束的任务通知, 而不是按固定的间隔(100毫秒)轮询
+        auto latency = returned - clock::time_point(clock::duration(last.load()));
+        CHECK(latency < std::chrono::milliseconds(50));
+    }
+
+    SECTION("Escalate to cleaning on timeout")
+    {
+        fiber_pool::pool pool{ 1 };
+
+        std::atomic<bool> interrupted{ false };
+        pool.post([&interrupted]() {
+            while (!boost::this_fiber::interrupted())
+                boost::this_fiber::sleep_for(std::chrono::milliseconds(5));
+            interrupted = true;
+        });
+
+        CHECK(!pool.shutdown_for(std::chrono::milliseconds(50)));
+        CHECK(interrupted);
+        CHECK(pool.state() == fiber_pool::pool::stoped);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     int result = Catch::Session().run(argc, argv);
@@ -0,0 +1,347 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef fiber_asio_h__
+#define fiber_asio_h__
+
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include <boost/asio/execution.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/fiber/future/promise.hpp>
+
+#include "fiber_pool.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief Asio的执行器, 将处理器作为纤程投递到池中
+ *
+ *  Asio的完成处理器与池中的纤程共享同一组工作线程, 以 boost::asio::bind_executor() 绑定后,
+ *  I/O完成时处理器直接投递到池的就绪队列, 而不是先回到io_context的线程再转投到池中.
+ *
+ *  满足Asio的标准执行器要求, 支持的属性:
+ *  - blocking.possibly(默认): 已在本池的工作线程上时就地调用, 同 boost::asio::dispatch();
+ *    blocking.never: 总是投递到新的纤程, 同 boost::asio::post().
+ *  - outstanding_work.tracked: 执行器存在期间计入池的未决任务, shutdown(true) 将等待其析构, 同 executor_work_guard.
+ *  - context: 返回所属的池.
+ *
+ *  @note  池的状态不为running时 execute() 抛出std::runtime_error. 处理器不受 pool_options::queue_capacity 的限制,
+ *         以免I/O完成时阻塞或者丢弃处理器, 使等待它的纤程无法推进.
+ */
+class pool_executor
+{
+    pool*       pool_;
+    priority_t  priority_;
+    bool        never_;     // blocking.never, 不就地调用
+    bool        tracked_;   // outstanding_work.tracked, 持有池的一个未决计数
+
+    pool_executor(pool_executor const& other, bool never, bool tracked) noexcept
+        : pool_(other.pool_)
+        , priority_(other.priority_)
+        , never_(never)
+        , tracked_(tracked)
+    {
+        if (tracked_)
+            pool_->hold();
+    }
+
+public:
+    explicit pool_executor(pool& p = get_fiber_pool(), priority_t priority = normal_priority) noexcept
+        : pool_(&p)
+        , priority_(priority)
+        , never_(false)
+        , tracked_(false)
+    {
+    }
+
+    pool_executor(pool_executor const& other) noexcept
+        : pool_executor(other, other.never_, other.tracked_)
+    {
+    }
+
+    pool_executor(pool_executor&& other) noexcept
+        : pool_(other.pool_)
+        , priority_(other.priority_)
+        , never_(other.never_)
+        , tracked_(other.tracked_)
+    {
+        other.tracked_ = false;
+    }
+
+    pool_executor& operator=(pool_executor const& other) noexcept
+    {
+        pool_executor copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    pool_executor& operator=(pool_executor&& other) noexcept
+    {
+        pool_executor moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~pool_executor()
+    {
+        if (tracked_)
+            pool_->unhold();
+    }
+
+    void swap(pool_executor& other) noexcept
+    {
+        std::swap(pool_, other.pool_);
+        std::swap(priority_, other.priority_);
+        std::swap(never_, other.never_);
+        std::swap(tracked_, other.tracked_);
+    }
+
+    pool& context() const noexcept {
+        return *pool_;
+    }
+
+    priority_t priority() const noexcept {
+        return priority_;
+    }
+
+    bool running_in_this_thread() const noexcept {
+        return pool_->running_in_this_thread();
+    }
+
+    friend bool operator==(pool_executor const& a, pool_executor const& b) noexcept {
+        return a.pool_ == b.pool_ && a.priority_ == b.priority_ && a.never_ == b.never_ && a.tracked_ == b.tracked_;
+    }
+
+    friend bool operator!=(pool_executor const& a, pool_executor const& b) noexcept {
+        return !(a == b);
+    }
+
+    // 属性
+    pool& query(boost::asio::execution::context_t) const noexcept {
+        return *pool_;
+    }
+
+    boost::asio::execution::blocking_t query(boost::asio::execution::blocking_t) const noexcept {
+        return never_ ? boost::asio::execution::blocking_t(boost::asio::execution::blocking.never)
+                      : boost::asio::execution::blocking_t(boost::asio::execution::blocking.possibly);
+    }
+
+    boost::asio::execution::outstanding_work_t query(boost::asio::execution::outstanding_work_t) const noexcept {
+        return tracked_ ? boost::asio::execution::outstanding_work_t(boost::asio::execution::outstanding_work.tracked)
+                        : boost::asio::execution::outstanding_work_t(boost::asio::execution::outstanding_work.untracked);
+    }
+
+    static constexpr boost::asio::execution::relationship_t query(boost::asio::execution::relationship_t) noexcept {
+        return boost::asio::execution::relationship.fork;
+    }
+
+    pool_executor require(boost::asio::execution::blocking_t::possibly_t) const noexcept {
+        return pool_executor(*this, false, tracked_);
+    }
+
+    pool_executor require(boost::asio::execution::blocking_t::never_t) const noexcept {
+        return pool_executor(*this, true, tracked_);
+    }
+
+    pool_executor require(boost::asio::execution::outstanding_work_t::tracked_t) const noexcept {
+        return pool_executor(*this, never_, true);
+    }
+
+    pool_executor require(boost::asio::execution::outstanding_work_t::untracked_t) const noexcept {
+        return pool_executor(*this, never_, false);
+    }
+
+    pool_executor require(boost::asio::execution::relationship_t::fork_t) const noexcept {
+        return *this;
+    }
+
+    template< typename Fn >
+    void execute(Fn&& fn) const
+    {
+        typedef typename std::decay< Fn >::type function_type;
+
+        if (!never_ && pool_->running_in_this_thread())
+        {
+            function_type f(std::forward< Fn >(fn));
+            f();
+            return;
+        }
+
+        pool_->post_unbounded(priority_, function_type(std::forward< Fn >(fn)));
+    }
+};
+
+/*!
+ *  @brief 挂起当前纤程等待Asio异步操作完成的完成令牌, 类似于 boost::asio::yield_context
+ *
+ *      std::size_t n = socket.async_read_some(buffer, fiber_pool::yield);
+ *      timer.async_wait(fiber_pool::yield[ec]);
+ *
+ *  异步操作返回处理器的参数: 去掉首个error_code之后没有参数时返回void, 一个参数时返回该参数, 否则返回std::tuple.
+ *  error_code表示失败时抛出boost::system::system_error, 以 yield[ec] 传入时改为写入ec.
+ *
+ *  @note  只挂起当前纤程, 不阻塞工作线程; 在纤程之外调用时阻塞当前线程. 处理器在完成者的线程中调用,
+ *         唤醒纤程即是唯一的一次线程切换. 处理器未被调用即被销毁时(如io_context析构)抛出 boost::fibers::future_error.
+ */
+class yield_t
+{
+    boost::system::error_code* ec_;
+public:
+    constexpr yield_t() noexcept
+        : ec_(nullptr)
+    {
+    }
+
+    yield_t operator[](boost::system::error_code& ec) const noexcept
+    {
+        yield_t token;
+        token.ec_ = &ec;
+        return token;
+    }
+
+    boost::system::error_code* error() const noexcept {
+        return ec_;
+    }
+};
+
+constexpr yield_t yield{};
+
+namespace detail {
+
+template< typename ... Ts >
+struct yield_values
+{
+    typedef std::tuple< Ts ... > type;
+
+    static type unpack(std::tuple< boost::system::error_code, Ts ... >&& t)
+    {
+        return unpack(std::move(t), std::index_sequence_for< Ts ... >());
+    }
+
+    template< std::size_t ... I >
+    static type unpack(std::tuple< boost::system::error_code, Ts ... >&& t, std::index_sequence< I ... >)
+    {
+        return type(std::get< I + 1 >(std::move(t)) ...);
+    }
+};
+
+template< typename T >
+struct yield_values< T >
+{
+    typedef T type;
+
+    static type unpack(std::tuple< boost::system::error_code, T >&& t)
+    {
+        return std::get< 1 >(std::move(t));
+    }
+};
+
+template<>
+struct yield_values<>
+{
+    typedef void type;
+
+    static void unpack(std::tuple< boost::system::error_code >&&)
+    {
+    }
+};
+
+/*!
+ *  以promise传递处理器的参数, HasError表示首个参数为error_code. 结果总是以error_code开头.
+ */
+template< bool HasError, typename ... Ts >
+class yield_handler
+{
+public:
+    typedef std::tuple< boost::system::error_code, Ts ... > result_type;
+
+    explicit yield_handler(boost::fibers::promise< result_type >&& promise)
+        : promise_(std::move(promise))
+    {
+    }
+
+    template< typename ... Args >
+    void operator()(Args&& ... args)
+    {
+        complete(std::integral_constant< bool, HasError >(), std::forward< Args >(args) ...);
+    }
+
+private:
+    template< typename ... Args >
+    void complete(std::true_type, boost::system::error_code const& ec, Args&& ... args)
+    {
+        promise_.set_value(result_type(ec, std::forward< Args >(args) ...));
+    }
+
+    template< typename ... Args >
+    void complete(std::false_type, Args&& ... args)
+    {
+        promise_.set_value(result_type(boost::system::error_code(), std::forward< Args >(args) ...));
+    }
+
+    boost::fibers::promise< result_type > promise_;
+};
+
+template< typename ... Args >
+struct yield_traits
+{
+    typedef yield_handler< false, Args ... > handler_type;
+    typedef yield_values< Args ... >         values;
+};
+
+template< typename ... Args >
+struct yield_traits< boost::system::error_code, Args ... >
+{
+    typedef yield_handler< true, Args ... > handler_type;
+    typedef yield_values< Args ... >        values;
+};
+
+} // detail
+
+} // fiber_pool
+
+namespace boost {
+namespace asio {
+
+template< typename R, typename ... Args >
+class async_result< fiber_pool::yield_t, R(Args ...) >
+{
+    typedef fiber_pool::detail::yield_traits< typename std::decay< Args >::type ... > traits;
+    typedef typename traits::handler_type::result_type                                result_type;
+
+public:
+    typedef typename traits::handler_type   completion_handler_type;
+    typedef typename traits::values::type   return_type;
+
+    template< typename Initiation, typename ... InitArgs >
+    static return_type initiate(Initiation&& initiation, fiber_pool::yield_t token, InitArgs&& ... args)
+    {
+        boost::fibers::promise< result_type > promise;
+        auto future = promise.get_future();
+
+        std::forward< Initiation >(initiation)(
+            completion_handler_type(std::move(promise)), std::forward< InitArgs >(args) ...);
+
+        result_type result = future.get();
+        boost::system::error_code const& ec = std::get< 0 >(result);
+        if (token.error() != nullptr)
+            *token.error() = ec;
+        else if (ec)
+            throw boost::system::system_error(ec);
+
+        return traits::values::unpack(std::move(result));
+    }
+};
+
+} // asio
+} // boost
+
+#endif // fiber_asio_h__
@@ -0,0 +1,393 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef fiber_coro_h__
+#define fiber_coro_h__
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#   error "fiber_coro.hpp requires C++20 coroutines."
+#endif
+
+#include <utility>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <type_traits>
+
+#include "fiber_pool.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief pool::schedule() 返回的等待体
+ *
+ *  挂起当前协程并在池中排队, 由池的驱动纤程恢复, 驱动纤程与其他纤程共享同一个就绪队列与优先级.
+ *  排队期间只占用协程帧(等待体本身即是队列的节点), 不占用纤程与纤程栈.
+ *
+ *  @note  协程在驱动纤程上运行, 应当 co_await 而不是阻塞纤程, 否则会延误同一驱动纤程上排队的其他协程.
+ */
+class schedule_awaiter : public detail::resumable
+{
+    pool&                   pool_;
+    priority_t              priority_;
+    std::coroutine_handle<> handle_;
+public:
+    schedule_awaiter(pool& p, priority_t priority) noexcept
+        : pool_(p)
+        , priority_(priority)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    // 池已关闭时异常从 co_await 表达式抛出, 协程继续在原处执行
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        handle_ = handle;
+        pool_.resume_later(this, priority_);
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+
+    void resume() noexcept
+    {
+        handle_.resume();
+    }
+};
+
+inline schedule_awaiter pool::schedule(priority_t priority/* = normal_priority*/) noexcept
+{
+    return schedule_awaiter{ *this, priority };
+}
+
+template< typename T = void >
+class task;
+
+namespace detail {
+
+// 协程结束时对称转移到等待者, 不增加调用栈的深度
+struct task_final_awaiter
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template< typename Promise >
+    std::coroutine_handle<> await_suspend(std::coroutine_handle< Promise > handle) noexcept
+    {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+};
+
+struct task_promise_base
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr      error;
+
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    task_final_awaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        error = std::current_exception();
+    }
+};
+
+template< typename T >
+struct task_promise : task_promise_base
+{
+    std::optional< T > value;
+
+    task< T > get_return_object() noexcept;
+
+    template< typename U >
+    void return_value(U&& v)
+    {
+        value.emplace(std::forward< U >(v));
+    }
+
+    T result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct task_promise< void > : task_promise_base
+{
+    task< void > get_return_object() noexcept;
+
+    void return_void() noexcept
+    {
+    }
+
+    void result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+// 独立运行的协程, 结束时自行销毁其协程帧
+struct detached_task
+{
+    struct promise_type
+    {
+        detached_task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+template< typename T >
+detached_task run_task(pool& p, task< T > t, boost::fibers::promise< T > promise,
+    continuation_list* continuations)
+{
+    try
+    {
+        co_await p.schedule();
+
+        if constexpr (std::is_void< T >::value)
+        {
+            co_await std::move(t);
+            promise.set_value();
+        }
+        else
+        {
+            promise.set_value(co_await std::move(t));
+        }
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+
+    // 列表位于promise的共享状态中, 在promise销毁之前触发后续操作
+    continuations->fire();
+}
+
+// co_await future 的等待体, Future为 future<R> 或其引用
+template< typename R, typename Future >
+class future_awaiter
+{
+    Future                            future_;
+    std::optional< schedule_awaiter > resumer_;
+public:
+    explicit future_awaiter(Future&& f)
+        : future_(std::forward< Future >(f))
+    {
+    }
+
+    bool await_ready() const
+    {
+        return future_.wait_for(std::chrono::seconds(0)) == boost::fibers::future_status::ready;
+    }
+
+    // 前驱就绪时将协程的恢复投递到生产者所属的池中
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        continuation_list* continuations = continuation_access::of(future_);
+        if (!future_.valid() || !continuations)
+            boost::throw_exception(boost::fibers::future_uninitialized());
+
+        // 没有所属的池时(如由空序列组合而来), 在前驱就绪的线程中直接恢复
+        pool* owner = continuations->owner();
+        if (owner != nullptr)
+            resumer_.emplace(*owner, normal_priority);
+
+        continuations->attach(continuation_list::make_callback([this, handle]() noexcept {
+            if (!resumer_)
+            {
+                handle.resume();
+                return;
+            }
+
+            try
+            {
+                resumer_->await_suspend(handle);
+            }
+            catch (...)
+            {
+                // 池已关闭, 只能在当前线程中恢复
+                handle.resume();
+            }
+        }));
+    }
+
+    R await_resume()
+    {
+        return future_.get();
+    }
+};
+
+} // detail
+
+/*!
+ *  @brief 惰性启动的协程任务
+ *
+ *  被 co_await 时才开始执行, 且在等待者所在的线程中开始; 需要在池中执行时, 在协程内先 co_await pool::schedule().
+ *  结束时对称转移到等待者. 协程挂起期间不占用纤程与纤程栈, 故可以同时存在大量的任务.
+ *
+ *  @see   spawn(), pool::schedule().
+ */
+template< typename T >
+class task
+{
+public:
+    typedef detail::task_promise< T > promise_type;
+
+    static_assert(!std::is_reference< T >::value, "task<T&> is not supported.");
+
+    task() noexcept = default;
+
+    explicit task(std::coroutine_handle< promise_type > handle) noexcept
+        : handle_(handle)
+    {
+    }
+
+    task(task&& right) noexcept
+        : handle_(std::exchange(right.handle_, nullptr))
+    {
+    }
+
+    task& operator=(task&& right) noexcept
+    {
+        if (this != &right)
+        {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(right.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    task(task const&) = delete;
+    task& operator=(task const&) = delete;
+
+    ~task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool valid() const noexcept
+    {
+        return static_cast<bool>(handle_);
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter
+        {
+            std::coroutine_handle< promise_type > handle;
+
+            bool await_ready() const noexcept
+            {
+                return !handle || handle.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+            {
+                handle.promise().continuation = continuation;
+                return handle;
+            }
+
+            T await_resume()
+            {
+                if (!handle)
+                    boost::throw_exception(boost::fibers::future_uninitialized());
+                return handle.promise().result();
+            }
+        };
+
+        return awaiter{ handle_ };
+    }
+
+private:
+    std::coroutine_handle< promise_type > handle_;
+};
+
+namespace detail {
+
+template< typename T >
+task< T > task_promise< T >::get_return_object() noexcept
+{
+    return task< T >{ std::coroutine_handle< task_promise >::from_promise(*this) };
+}
+
+inline task< void > task_promise< void >::get_return_object() noexcept
+{
+    return task< void >{ std::coroutine_handle< task_promise >::from_promise(*this) };
+}
+
+} // detail
+
+/*!
+ *  @brief 在池中启动协程任务, 并返回其结果的future
+ *
+ *  @note  返回的future可以通过 future::then() 串联, 或者在其他协程中 co_await.
+ *         与纤程不同, 挂起中的协程不计入 pool::fiber_count(), 关闭池时也不会等待.
+ */
+template< typename T >
+future< T > spawn(pool& p, task< T > t)
+{
+    detail::continuation_list* continuations = nullptr;
+    auto promise = detail::make_continuable_promise< T >(&p, continuations);
+    future< T > f{ promise.get_future(), continuations };
+
+    detail::run_task(p, std::move(t), std::move(promise), continuations);
+    return f;
+}
+
+/*!
+ *  @brief 在默认的池中启动协程任务.
+ */
+template< typename T >
+future< T > spawn(task< T > t)
+{
+    return spawn(get_fiber_pool(), std::move(t));
+}
+
+/*!
+ *  @brief 在协程中等待future, 前驱就绪后在其生产者所属的池中恢复, 等待期间不占用纤程.
+ */
+template< typename R >
+detail::future_awaiter< R, future< R >& > operator co_await(future< R >& f)
+{
+    return detail::future_awaiter< R, future< R >& >{ f };
+}
+
+template< typename R >
+detail::future_awaiter< R, future< R > > operator co_await(future< R >&& f)
+{
+    return detail::future_awaiter< R, future< R > >{ std::move(f) };
+}
+
+} // fiber_pool
+
+#endif // fiber_coro_h__
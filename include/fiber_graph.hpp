@@ -0,0 +1,256 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef fiber_graph_h__
+#define fiber_graph_h__
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+
+#include "fiber_pool.hpp"
+
+#include <boost/fiber/mutex.hpp>
+#include <boost/fiber/condition_variable.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 任务图, 以有向无环图描述任务之间的依赖关系并在池中执行
+ *
+ *  每个节点带有一个依赖计数, 节点执行完毕时递减其所有后继的计数, 归零的后继即刻就绪:
+ *  第一个就绪的后继直接在当前纤程中继续执行, 其余的投递到池中(在工作线程中投递时优先进入该线程的本地队列).
+ *  图的结构在构建时分配, 之后可以反复执行 run() 而不再分配内存.
+ *
+ *  @note  构建与执行不能同时进行, 同一个图也不能同时执行多次.
+ */
+class task_graph
+{
+public:
+    typedef size_t node_id;
+
+    task_graph() = default;
+    task_graph(task_graph const&) = delete;
+    task_graph& operator=(task_graph const&) = delete;
+
+    /*!
+     *  @brief 添加一个节点
+     *  @return 节点的编号, 按添加的顺序从0开始.
+     */
+    template< typename Fn >
+    node_id emplace(Fn&& fn)
+    {
+        nodes_.emplace_back(nodes_.size(), std::forward< Fn >(fn));
+        validated_ = false;
+        return nodes_.size() - 1;
+    }
+
+    /*!
+     *  @brief 添加一条边, 使before执行完毕之后after才开始执行
+     */
+    void precede(node_id before, node_id after)
+    {
+        if (before >= nodes_.size() || after >= nodes_.size() || before == after)
+            throw std::invalid_argument("Invalid task graph edge.");
+
+        nodes_[before].successors.push_back(&nodes_[after]);
+        ++nodes_[after].predecessors;
+        validated_ = false;
+    }
+
+    size_t size() const noexcept
+    {
+        return nodes_.size();
+    }
+
+    void clear() noexcept
+    {
+        nodes_.clear();
+        validated_ = true;
+    }
+
+    /*!
+     *  @brief 在池中执行所有节点, 并等待全部执行完毕
+     *
+     *  @note  节点抛出异常后, 尚未开始的节点被跳过, 全部结束后重新抛出第一个异常.
+     *         图中存在环时抛出std::logic_error. 可以在池内的纤程中调用.
+     */
+    void run(pool& p)
+    {
+        if (nodes_.empty())
+            return;
+
+        if (!validated_)
+            validate();
+
+        if (p.state() != pool::running)
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        for (auto& n : nodes_)
+            n.pending.store(n.predecessors, boost::memory_order_relaxed);
+
+        error_ = nullptr;
+        done_ = false;
+        failed_.store(false, boost::memory_order_relaxed);
+        remaining_.store(nodes_.size());
+
+        for (auto& n : nodes_)
+        {
+            if (n.predecessors == 0)
+                schedule(p, &n);
+        }
+
+        std::unique_lock< boost::fibers::mutex > lk{ mtx_ };
+        cnd_.wait(lk, [this]() { return done_; });
+
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+
+    /*!
+     *  @brief 在默认的池中执行 run().
+     */
+    void run()
+    {
+        run(get_fiber_pool());
+    }
+
+private:
+    struct node
+    {
+        template< typename Fn >
+        node(size_t i, Fn&& f)
+            : index(i)
+            , fn(std::forward< Fn >(f))
+        {
+        }
+
+        size_t                  index;
+        std::function< void() > fn;
+        std::vector< node* >    successors;
+        size_t                  predecessors{ 0 };
+        boost::atomic_size_t    pending{ 0 };   // 本次执行中尚未完成的前驱数
+    };
+
+    // 拓扑排序检查是否存在环
+    void validate()
+    {
+        std::vector< size_t > degree(nodes_.size());
+        std::vector< node* >  ready;
+        for (size_t i = 0; i < nodes_.size(); ++i)
+        {
+            degree[i] = nodes_[i].predecessors;
+            if (degree[i] == 0)
+                ready.push_back(&nodes_[i]);
+        }
+
+        size_t visited = 0;
+        while (!ready.empty())
+        {
+            node* n = ready.back();
+            ready.pop_back();
+            ++visited;
+
+            for (node* s : n->successors)
+            {
+                if (--degree[s->index] == 0)
+                    ready.push_back(s);
+            }
+        }
+
+        if (visited != nodes_.size())
+            throw std::logic_error("The task graph contains a cycle.");
+
+        validated_ = true;
+    }
+
+    // 投递失败(如池已关闭)时在当前纤程中执行, 其后的节点均被跳过.
+    // 节点不计入 pool_options::queue_capacity, 否则被丢弃的节点将使 run() 永远等待
+    void schedule(pool& p, node* n) noexcept
+    {
+        try
+        {
+            p.post_unbounded(normal_priority, [this, &p, n]() { execute(p, n); });
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+            execute(p, n);
+        }
+    }
+
+    void execute(pool& p, node* n) noexcept
+    {
+        while (n != nullptr)
+        {
+            if (!failed_.load(boost::memory_order_relaxed))
+            {
+                try
+                {
+                    n->fn();
+                }
+                catch (...)
+                {
+                    fail(std::current_exception());
+                }
+            }
+
+            node* next = nullptr;
+            for (node* s : n->successors)
+            {
+                if (s->pending.fetch_sub(1) != 1)
+                    continue;
+
+                if (next == nullptr)
+                    next = s;
+                else
+                    schedule(p, s);
+            }
+
+            // 最后一个节点完成后调用者可能立即返回并销毁本图, 此后不能再访问成员
+            complete();
+            n = next;
+        }
+    }
+
+    void fail(std::exception_ptr error) noexcept
+    {
+        std::unique_lock< boost::fibers::mutex > lk{ mtx_ };
+        if (!error_)
+            error_ = error;
+        failed_.store(true);
+    }
+
+    // 在锁内设置完成标记, 使调用者在此之后才能返回
+    void complete() noexcept
+    {
+        if (remaining_.fetch_sub(1) == 1)
+        {
+            std::unique_lock< boost::fibers::mutex > lk{ mtx_ };
+            done_ = true;
+            cnd_.notify_all();
+        }
+    }
+
+    std::deque< node >      nodes_;     // deque保证添加节点时已有节点的地址不变
+    bool                    validated_{ true };
+
+    boost::atomic_size_t    remaining_{ 0 };
+    boost::atomic_bool      failed_{ false };
+    std::exception_ptr      error_;
+    bool                    done_{ false };
+
+    boost::fibers::mutex              mtx_;
+    boost::fibers::condition_variable cnd_;
+};
+
+} // fiber_pool
+
+#endif // fiber_graph_h__
@@ -0,0 +1,289 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef fiber_group_h__
+#define fiber_group_h__
+
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+
+#include "fiber_pool.hpp"
+
+#include <boost/fiber/mutex.hpp>
+#include <boost/fiber/condition_variable.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 任务组, 结构化地管理一组子任务
+ *
+ *  spawn() 将子任务放入组内的队列并投递一个执行者纤程到池中, 执行者纤程从队列中取出一个任务执行;
+ *  wait() 在阻塞之前先在调用者中执行队列中尚未开始的任务, 而不是空等. 组内只维护一个未完成的任务计数,
+ *  不持有各子任务的纤程句柄. cancel() 置位组内共享的取消标记, 所有子任务的 this_fiber::interrupted()
+ *  随即返回true, 尚未开始的子任务被丢弃, 代价与子任务的数量无关.
+ *
+ *  @note  析构时等待所有子任务结束; 因异常而析构时先取消. 在调用者中执行的子任务期间, 调用者的
+ *         this_fiber::interrupted() 同样反映组的取消标记.
+ */
+class task_group
+{
+public:
+    explicit task_group(pool& p = get_fiber_pool())
+        : pool_(p)
+        , state_(std::make_shared< shared_state >())
+    {
+    }
+
+    task_group(task_group const&) = delete;
+    task_group& operator=(task_group const&) = delete;
+
+    ~task_group()
+    {
+        if (std::uncaught_exceptions() > 0)
+            cancel();
+
+        try
+        {
+            wait();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /*!
+     *  @brief 在组内启动一个子任务
+     *  @note  子任务抛出的异常取消整个组, 并由 wait() 重新抛出.
+     */
+    template< typename Fn >
+    void spawn(Fn&& fn)
+    {
+        spawn(normal_priority, std::forward< Fn >(fn));
+    }
+
+    /*!
+     *  @brief 以指定的优先级启动一个子任务.
+     *  @see   spawn().
+     */
+    template< typename Fn >
+    void spawn(priority_t priority, Fn&& fn)
+    {
+        typedef task_impl< typename std::decay< Fn >::type > impl_type;
+
+        if (pool_.state() != pool::running)
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        state_->push(new impl_type(std::forward< Fn >(fn)));
+
+        // 执行者纤程不一定取到自己投递的任务, 队列可能已被其他执行者或者 wait() 取空.
+        // 投递失败时任务仍留在队列中, 由 wait() 执行
+        try
+        {
+            auto runner = [state = state_]() { state->run_one(); };
+
+            pool::runnable_holder runnable;
+            runnable.emplace< pool::closure< decltype(runner) > >(std::move(runner));
+            pool_.dispatch(std::move(runnable), priority, &state_->cancelled);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /*!
+     *  @brief 等待所有子任务结束
+     *
+     *  先在调用者中执行队列中尚未开始的子任务, 再等待其余正在执行的子任务.
+     *  @note  返回后组的取消状态被重置, 可以继续启动新的子任务. 重新抛出子任务抛出的第一个异常.
+     */
+    void wait()
+    {
+        if (pool_.state() >= pool::cleaning)
+            cancel();
+
+        {
+            cancellation_scope scope{ state_->cancelled };
+            while (state_->run_one())
+                ;
+        }
+
+        state_->wait();
+    }
+
+    /*!
+     *  @brief 取消组内所有的子任务
+     *  @note  正在执行的子任务需要通过 this_fiber::interrupted() 自行检查并退出.
+     */
+    void cancel() noexcept
+    {
+        state_->cancelled.store(true);
+    }
+
+    bool cancelled() const noexcept
+    {
+        return state_->cancelled.load(boost::memory_order_relaxed);
+    }
+
+private:
+    // 在调用者中执行子任务期间, 以组的取消标记替换调用者的取消标记
+    class cancellation_scope
+    {
+        boost::atomic_bool const* previous_;
+    public:
+        explicit cancellation_scope(boost::atomic_bool const& cancelled) noexcept
+            : previous_(pool::exchange_cancellation(&cancelled))
+        {
+        }
+
+        ~cancellation_scope()
+        {
+            pool::exchange_cancellation(previous_);
+        }
+
+        cancellation_scope(cancellation_scope const&) = delete;
+        cancellation_scope& operator=(cancellation_scope const&) = delete;
+    };
+
+    struct task
+    {
+        task* next{ nullptr };
+
+        virtual ~task() {}
+        virtual void run() = 0;
+    };
+
+    template< typename Fn >
+    struct task_impl : task
+    {
+        Fn fn;
+
+        template< typename F >
+        explicit task_impl(F&& f)
+            : fn(std::forward< F >(f))
+        {
+        }
+
+        void run() { fn(); }
+    };
+
+    // 组与执行者纤程共享的状态, 执行者纤程可能晚于组的析构才被调度
+    struct shared_state
+    {
+        boost::atomic_bool      cancelled{ false };
+        boost::atomic_size_t    pending{ 0 };   // 尚未结束的子任务数
+
+        std::mutex              queue_mtx;
+        task*                   head{ nullptr };
+        task*                   tail{ nullptr };
+
+        boost::fibers::mutex              mtx;
+        boost::fibers::condition_variable cnd;
+        bool                              idle{ true };
+        std::exception_ptr                error;
+
+        ~shared_state()
+        {
+            while (head != nullptr)
+                delete std::exchange(head, head->next);
+        }
+
+        void push(task* t) noexcept
+        {
+            if (pending.fetch_add(1) == 0)
+                update_idle();
+
+            std::unique_lock< std::mutex > lk{ queue_mtx };
+            if (tail != nullptr)
+                tail->next = t;
+            else
+                head = t;
+            tail = t;
+        }
+
+        task* pop() noexcept
+        {
+            std::unique_lock< std::mutex > lk{ queue_mtx };
+            task* t = head;
+            if (t != nullptr)
+            {
+                head = t->next;
+                if (head == nullptr)
+                    tail = nullptr;
+            }
+            return t;
+        }
+
+        // 取出并执行一个排队的子任务, 队列为空时返回false
+        bool run_one() noexcept
+        {
+            std::unique_ptr< task > t{ pop() };
+            if (!t)
+                return false;
+
+            if (!cancelled.load(boost::memory_order_relaxed))
+            {
+                try
+                {
+                    t->run();
+                }
+                catch (...)
+                {
+                    fail(std::current_exception());
+                }
+            }
+
+            t.reset();
+
+            if (pending.fetch_sub(1) == 1)
+                update_idle();
+
+            return true;
+        }
+
+        void wait()
+        {
+            std::exception_ptr e;
+            {
+                std::unique_lock< boost::fibers::mutex > lk{ mtx };
+                cnd.wait(lk, [this]() { return idle; });
+
+                std::swap(e, error);
+                cancelled.store(false);
+            }
+
+            if (e)
+                std::rethrow_exception(e);
+        }
+
+        void fail(std::exception_ptr e) noexcept
+        {
+            std::unique_lock< boost::fibers::mutex > lk{ mtx };
+            if (!error)
+                error = e;
+            cancelled.store(true);
+        }
+
+        // 计数在0与非0之间变化时在锁内重新求值, 计数归零时唤醒等待者
+        void update_idle() noexcept
+        {
+            std::unique_lock< boost::fibers::mutex > lk{ mtx };
+            idle = pending.load() == 0;
+            if (idle)
+                cnd.notify_all();
+        }
+    };
+
+    pool&                           pool_;
+    std::shared_ptr< shared_state > state_;
+};
+
+} // fiber_pool
+
+#endif // fiber_group_h__
@@ -0,0 +1,88 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef fiber_io_h__
+#define fiber_io_h__
+
+#include <boost/predef/os.h>
+
+#if BOOST_OS_WINDOWS
+#   error "fiber_io.hpp requires a POSIX platform."
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>
+
+#include "fiber_pool.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  纤程感知的文件描述符I/O, 等待时只挂起当前纤程, 工作线程继续运行其他纤程.
+ *
+ *  在启用了 pool_options::reactor 的池的工作线程上, 描述符被设置为非阻塞, 遇到EAGAIN时在池的I/O反应器上等待;
+ *  其他情况下(非工作线程, 或者未启用反应器)在 blocking() 区域中以poll()阻塞等待.
+ *  失败时抛出std::system_error异常, 池正在清理时等待中的纤程以ECANCELED被唤醒.
+ *
+ *  read_at()等在启用了 pool_options::uring 的池的工作线程上以io_uring执行, 请求成批提交, 完成前只挂起当前纤程;
+ *  其他情况下 read_at()/write_at() 在 blocking() 区域中同步调用, recv()/send() 与 async_read() 一样等待.
+ *
+ *  @note  同一描述符上同时至多有一个纤程读(或accept)与一个纤程写, 否则抛出EBUSY; io_uring的请求没有此限制.
+ *         普通文件不支持epoll, 应使用 read_at()/write_at().
+ */
+namespace io {
+    /*!
+     *  @brief 读取至多n字节, 返回实际读取的字节数, 0表示对端已关闭
+     */
+    FIBER_POOL_DECL std::size_t async_read(int fd, void* buf, std::size_t n);
+
+    /*!
+     *  @brief 写入全部n字节后返回
+     *  @note  中途失败时已写入的部分无法撤销, 字节数不会通过异常报告.
+     */
+    FIBER_POOL_DECL void async_write(int fd, void const* buf, std::size_t n);
+
+    /*!
+     *  @brief 接受一个连接, 返回新的描述符
+     *  @note  新描述符设置了close-on-exec, 尚未设置为非阻塞, 首次I/O时设置.
+     */
+    FIBER_POOL_DECL int accept(int fd, sockaddr* addr = nullptr, socklen_t* addrlen = nullptr);
+
+    /*!
+     *  挂起当前纤程直到fd可读
+     */
+    FIBER_POOL_DECL void wait_readable(int fd);
+
+    /*!
+     *  挂起当前纤程直到fd可写, 如等待非阻塞connect()完成
+     */
+    FIBER_POOL_DECL void wait_writable(int fd);
+
+    /*!
+     *  @brief 从offset处读取至多n字节, 返回实际读取的字节数, 0表示已到文件末尾
+     */
+    FIBER_POOL_DECL std::size_t read_at(int fd, void* buf, std::size_t n, std::uint64_t offset);
+
+    /*!
+     *  @brief 从offset处写入全部n字节后返回
+     */
+    FIBER_POOL_DECL void write_at(int fd, void const* buf, std::size_t n, std::uint64_t offset);
+
+    /*!
+     *  @brief 接收至多n字节, 返回实际接收的字节数, 0表示对端已关闭
+     */
+    FIBER_POOL_DECL std::size_t recv(int fd, void* buf, std::size_t n, int flags = 0);
+
+    /*!
+     *  @brief 发送至多n字节, 返回实际发送的字节数
+     */
+    FIBER_POOL_DECL std::size_t send(int fd, void const* buf, std::size_t n, int flags = 0);
+}
+
+} // fiber_pool
+
+#endif // fiber_io_h__
@@ -0,0 +1,297 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef fiber_parallel_h__
+#define fiber_parallel_h__
+
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <exception>
+
+#include "fiber_pool.hpp"
+
+#include <boost/fiber/mutex.hpp>
+#include <boost/fiber/condition_variable.hpp>
+
+namespace fiber_pool {
+namespace detail {
+
+/*!
+ *  @brief 数据并行算法的共享状态
+ *
+ *  所有参与者(调用者以及投递到池中的辅助纤程)通过一个原子游标领取[0, n)中的分块,
+ *  分块的大小随剩余的元素数递减(不小于grain), 先领取的参与者拿到较大的分块,
+ *  后期的小分块用于平衡各参与者的结束时间.
+ */
+class parallel_state
+{
+    size_t                      size_;
+    size_t                      grain_;
+    size_t                      participants_;
+    boost::atomic_size_t        next_{ 0 };     // 下一个未被领取的元素
+    boost::atomic_size_t        done_{ 0 };     // 已经完成的元素数
+    boost::atomic_bool          failed_{ false };
+    std::exception_ptr          error_;
+
+    boost::fibers::mutex              mtx_;
+    boost::fibers::condition_variable cnd_;
+
+public:
+    parallel_state(size_t size, size_t grain, size_t participants)
+        : size_(size)
+        , grain_((std::max)(grain, size_t(1)))
+        , participants_(participants)
+    {
+    }
+
+    // 领取一个分块[begin, end), 已全部领取时返回false
+    bool next(size_t& begin, size_t& end) noexcept
+    {
+        size_t pos = next_.load(boost::memory_order_relaxed);
+        size_t chunk;
+        do
+        {
+            if (pos >= size_)
+                return false;
+
+            size_t remaining = size_ - pos;
+            chunk = (std::max)(grain_, remaining / (participants_ * 2));
+            chunk = (std::min)(chunk, remaining);
+        } while (!next_.compare_exchange_weak(pos, pos + chunk, boost::memory_order_relaxed));
+
+        begin = pos;
+        end = pos + chunk;
+        return true;
+    }
+
+    // 有参与者抛出异常后, 之后领取的分块不再执行
+    bool failed() const noexcept
+    {
+        return failed_.load(boost::memory_order_relaxed);
+    }
+
+    void fail(std::exception_ptr error) noexcept
+    {
+        std::unique_lock< boost::fibers::mutex > lk{ mtx_ };
+        if (!error_)
+            error_ = error;
+        failed_.store(true);
+    }
+
+    void complete(size_t count) noexcept
+    {
+        if (done_.fetch_add(count) + count == size_)
+        {
+            std::unique_lock< boost::fibers::mutex > lk{ mtx_ };
+            cnd_.notify_all();
+        }
+    }
+
+    // 等待所有分块完成, 并重新抛出参与者抛出的第一个异常
+    void wait()
+    {
+        {
+            std::unique_lock< boost::fibers::mutex > lk{ mtx_ };
+            cnd_.wait(lk, [this]() { return done_.load() == size_; });
+        }
+
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+
+    /*!
+     *  @brief 作为一个参与者领取并执行分块, 直到全部被领取
+     *
+     *  只有领取到分块后才通过 make_body() 创建分块函数, 此时调用者必然仍在等待, 故其可以引用调用者的局部变量.
+     *  参与者在调用分块函数的 finish() 之后才计入完成, 保证调用者返回前所有的 finish() 均已执行.
+     */
+    template< typename MakeBody >
+    void participate(MakeBody& make_body) noexcept
+    {
+        size_t begin, end;
+        if (!next(begin, end))
+            return;
+
+        size_t count = 0;
+        try
+        {
+            auto body = make_body();
+            do
+            {
+                count += end - begin;
+                if (!failed())
+                    body(begin, end);
+            } while (next(begin, end));
+
+            body.finish();
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+
+            while (next(begin, end))
+                count += end - begin;
+        }
+
+        complete(count);
+    }
+};
+
+/*!
+ *  @brief 在池中并行地对[0, size)执行 make_body() 返回的分块函数
+ *
+ *  除调用者外, 按照池中空闲的工作线程数投递辅助纤程, 调用者自身同样参与执行而不是阻塞等待.
+ *  make_body() 为每个参与者创建一个分块函数, 参与者结束时调用其 finish().
+ */
+template< typename MakeBody >
+void parallel_run(pool& p, size_t size, size_t grain, MakeBody& make_body)
+{
+    if (size == 0)
+        return;
+
+    grain = (std::max)(grain, size_t(1));
+
+    // 辅助纤程数与空闲的工作线程数成比例, 至少一个以便忙碌的线程空闲后加入
+    size_t chunks = (size + grain - 1) / grain;
+    size_t helpers = (std::min)({ chunks - 1,
+        (std::max)(p.idle_count(), size_t(1)), p.thread_count() });
+
+    auto state = std::make_shared<parallel_state>(size, grain, helpers + 1);
+
+    // 就绪队列已满(参见 pool_options::queue_capacity)时不再投递辅助纤程, 剩余的分块由调用者执行.
+    // 投递失败(池已不在running状态)时, 已投递的辅助纤程仍然引用make_body, 故同样先等待所有分块完成再抛出
+    std::exception_ptr error;
+    try
+    {
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            if (!p.try_post([state, &make_body]() { state->participate(make_body); }))
+                break;
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    state->participate(make_body);
+    state->wait();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // detail
+
+/*!
+ *  @brief 并行地对[first, last)中的每个索引执行 fn(i)
+ *
+ *  @param p     执行的池, 调用者也参与执行, 故可以在池内的纤程中调用.
+ *  @param grain 每个分块的最小元素数, 分块内的元素在同一个纤程中顺序执行.
+ *  @note  Index 可以是整数或者随机访问迭代器. fn抛出异常时, 尚未执行的分块被跳过,
+ *         等待已领取的分块完成后重新抛出第一个异常. 池的状态不为running时, 调用者独自执行所有分块后
+ *         抛出std::runtime_error.
+ */
+template< typename Index, typename Fn >
+void parallel_for(pool& p, Index first, Index last, size_t grain, Fn&& fn)
+{
+    typedef decltype(last - first) difference_type;
+
+    struct body_type
+    {
+        Index first;
+        Fn&   fn;
+
+        void operator()(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                fn(first + static_cast<difference_type>(i));
+        }
+
+        void finish() {}
+    };
+
+    auto make_body = [&]() { return body_type{ first, fn }; };
+
+    size_t size = last > first ? static_cast<size_t>(last - first) : 0;
+    detail::parallel_run(p, size, grain, make_body);
+}
+
+/*!
+ *  @brief 在默认的池中执行 parallel_for().
+ */
+template< typename Index, typename Fn >
+void parallel_for(Index first, Index last, size_t grain, Fn&& fn)
+{
+    parallel_for(get_fiber_pool(), first, last, grain, std::forward< Fn >(fn));
+}
+
+/*!
+ *  @brief 并行归约
+ *
+ *  每个参与者以identity为初值, 对领取的分块依次执行 value = body(begin, end, value),
+ *  其中[begin, end)是[first, last)的子区间; 最后以 reduce(a, b) 合并各参与者的结果.
+ *
+ *  @param identity 归约的单位元, reduce(identity, x) == x.
+ *  @note  各参与者结果的合并顺序不确定, 故 reduce 需要满足结合律与交换律.
+ *  @see   parallel_for().
+ */
+template< typename Index, typename T, typename Body, typename Reduce >
+T parallel_reduce(pool& p, Index first, Index last, size_t grain,
+    T identity, Body&& body, Reduce&& reduce)
+{
+    typedef decltype(last - first) difference_type;
+
+    std::mutex mtx;
+    T result = identity;
+
+    struct body_type
+    {
+        Index       first;
+        Body&       body;
+        Reduce&     reduce;
+        std::mutex& mtx;
+        T&          result;
+        T           value;
+
+        void operator()(size_t begin, size_t end)
+        {
+            value = body(first + static_cast<difference_type>(begin),
+                first + static_cast<difference_type>(end), std::move(value));
+        }
+
+        void finish()
+        {
+            std::unique_lock< std::mutex > lk{ mtx };
+            result = reduce(std::move(result), std::move(value));
+        }
+    };
+
+    auto make_body = [&]() {
+        return body_type{ first, body, reduce, mtx, result, identity }; };
+
+    size_t size = last > first ? static_cast<size_t>(last - first) : 0;
+    detail::parallel_run(p, size, grain, make_body);
+
+    return result;
+}
+
+/*!
+ *  @brief 在默认的池中执行 parallel_reduce().
+ */
+template< typename Index, typename T, typename Body, typename Reduce >
+T parallel_reduce(Index first, Index last, size_t grain,
+    T identity, Body&& body, Reduce&& reduce)
+{
+    return parallel_reduce(get_fiber_pool(), first, last, grain, std::move(identity),
+        std::forward< Body >(body), std::forward< Reduce >(reduce));
+}
+
+} // fiber_pool
+
+#endif // fiber_parallel_h__
@@ -54,8 +54,20 @@
 #    define BOOST_CONTEXT_DYN_LINK 1
 #endif
 
+#include <new>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <vector>
+#include <optional>
+#include <exception>
+#include <iterator>
+#include <type_traits>
+
 #include <boost/any.hpp>
 #include <boost/atomic.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/fiber/fiber.hpp>
 #include <boost/fiber/future.hpp>
@@ -67,7 +79,8 @@
 namespace boost {
     namespace this_fiber {
         /*!
-         *  返回当前纤程是否被中断
+         *  返回当前纤程是否被中断, 所属的池正在清理, 或者所属的 task_group 已被取消
+         *  @note  不访问池对象, 开销仅为一次线程局部读取与至多三次relaxed读取, 可以在计算密集的循环中频繁调用.
          */
         FIBER_POOL_DECL bool interrupted();
 
@@ -86,64 +99,813 @@ namespace boost {
 
 namespace fiber_pool {
 
+/*!
+ *  睡眠在池的时间轮上, 与 boost::this_fiber::sleep_for() 不同, 所有工作线程上睡眠的纤程共享一个定时器结构,
+ *  只由一个空闲的工作线程按最近的到期时间挂起, 同时到期的纤程被批量唤醒.
+ */
+namespace this_fiber {
+    /*!
+     *  @brief 挂起当前纤程直到time_point
+     *  @note  精度为1ms, 唤醒不早于time_point. 不在池的工作线程上时退化为 boost::this_fiber::sleep_until().
+     */
+    FIBER_POOL_DECL void sleep_until(std::chrono::steady_clock::time_point const& time_point);
+
+    template< typename Clock, typename Duration >
+    void sleep_until(std::chrono::time_point< Clock, Duration > const& time_point)
+    {
+        sleep_until(std::chrono::steady_clock::now() +
+            std::chrono::duration_cast< std::chrono::steady_clock::duration >(time_point - Clock::now()));
+    }
+
+    template< typename Rep, typename Period >
+    void sleep_for(std::chrono::duration< Rep, Period > const& duration)
+    {
+        sleep_until(std::chrono::steady_clock::now() +
+            std::chrono::duration_cast< std::chrono::steady_clock::duration >(duration));
+    }
+}
+
 /*!
  *  @brief 扩展boost::fibers::fiber
  *         使之可以优雅的终止未决的任务, 但同时使之丧失运行纤程的能力.
  *  @note  另一个区别是fiber对象析构时会自动与未决的纤程分离.
+ *         fiber对象仅持有纤程上下文的侵入式引用, 构造与复制均不分配内存.
  */
 class FIBER_POOL_DECL fiber
 {
 public:
     typedef boost::fibers::fiber::id id;
 
-    fiber();
-    fiber(const fiber& right);
+    fiber() noexcept;
+    fiber(const fiber& right) noexcept;
+    fiber(fiber&& right) noexcept;
     fiber(boost::fibers::fiber&& fiber);
+    ~fiber();
 
-    fiber & operator=(const fiber& right);
+    fiber & operator=(const fiber& right) noexcept;
+    fiber & operator=(fiber&& right) noexcept;
 
     id   get_id() const noexcept;
     bool finshed() const noexcept;      //!< 判断是否执行完成(执行完成或已经被中断)
     bool joinable() const noexcept;     //!< 类似于thread::joinable()(执行中或执行完成)
-    void join();                        //!< 等待执行完成或者中断.
+    void join();                        //!< 等待执行完成或者中断, 之后该对象不再指向纤程.
     void interrupt();                   //!< 请求中断该纤程, 参见 interrupted().
-    void interrupt_on_destruct();       //!< 析构时请求中断
+    void interrupt_on_destruct();       //!< 最后一个指向该纤程的对象析构时请求中断
 
 protected:
+    void release() noexcept;
+
 #if _MSC_VER
 #   pragma warning (push)
 #   pragma warning (disable:4251)
 #endif
-    std::shared_ptr<struct fiber_private> m_private;
+    boost::intrusive_ptr<boost::fibers::context> m_context;
 #if _MSC_VER
 #   pragma warning (pop)
 #endif
 };
 
+/*!
+ *  调度算法
+ */
+enum scheduling_t
+{
+    shared_work,    //!< 所有工作线程共享同一个就绪队列.
+    work_stealing,  //!< 每个工作线程拥有本地队列, 空闲时从其他线程的队列中窃取纤程.
+};
+
+/*!
+ *  纤程优先级, 每个调度点总是先调度优先级高的纤程, 同一优先级内先进先出.
+ */
+enum priority_t
+{
+    low_priority,       //!< 后台批处理任务
+    normal_priority,    //!< 默认优先级
+    high_priority,
+    critical_priority,  //!< 对延迟敏感的任务
+};
+
+/*!
+ *  纤程栈的分配方式
+ */
+enum stack_allocator_t
+{
+    fixedsize_stack,            //!< 每个纤程单独分配栈, 结束后释放.
+    protected_fixedsize_stack,  //!< 同上, 但栈的末尾带有保护页, 溢出时触发访问异常.
+    pooled_fixedsize_stack,     //!< 纤程结束后栈被缓存, 供之后的纤程复用.
+};
+
+/*!
+ *  工作线程的CPU亲和性
+ */
+enum affinity_t
+{
+    no_affinity,    //!< 工作线程可在所有CPU之间迁移, 所有线程共享同一个共享队列.
+    numa_affinity,  //!< 工作线程按NUMA节点分组并限定在所属节点的CPU上, 每个节点拥有独立的共享队列, 优先在节点内窃取.
+    core_affinity,  //!< 同上, 且每个工作线程绑定到所属节点内的一个逻辑CPU.
+};
+
+/*!
+ *  就绪队列已满时 post() 的处理方式, 参见 pool_options::queue_capacity
+ */
+enum overflow_t
+{
+    overflow_block,         //!< 阻塞投递者直到有任务开始执行, 在池内的纤程中投递时只挂起该纤程.
+    overflow_reject,        //!< 抛出std::runtime_error, 任务未被投递.
+    overflow_drop_oldest,   //!< 丢弃最早投递而尚未开始执行的任务, 其可调用对象被销毁而不执行, async()的future得到broken_promise, 被丢弃而尚未结束的纤程也达到容量时同overflow_block.
+};
+
+/*!
+ *  纤程池的配置参数
+ */
+struct pool_options
+{
+    size_t       threads{ size_t(-1) };     //!< 池中常驻的线程数, -1则使用逻辑CPU*2;
+    size_t       max_threads{ 0 };          //!< 工作线程停滞(如阻塞在系统调用中)且有纤程排队时最多扩展到的线程数, 不大于threads则线程数固定
+    size_t       idle_timeout{ 10000 };     //!< 扩展出的线程在该时间(毫秒)内没有运行任何纤程时退出
+    scheduling_t scheduling{ shared_work }; //!< 工作线程所使用的调度算法
+    size_t       spin_count{ 256 };         //!< 工作线程空闲时, 挂起前自旋检查任务的次数
+    size_t       yield_count{ 4 };          //!< 自旋之后, 挂起前让出时间片检查任务的次数, 均为0则立即挂起
+    stack_allocator_t stack_allocator{ pooled_fixedsize_stack }; //!< 纤程栈的分配方式
+    size_t       stack_size{ 0 };           //!< 纤程栈的大小, 0则使用boost的默认值
+    size_t       stack_cache{ 256 };        //!< 使用pooled_fixedsize_stack时, 工作线程之间共享缓存的栈数上限
+    affinity_t   affinity{ no_affinity };   //!< 工作线程的CPU亲和性, 单节点的机器上只影响线程的绑定
+    bool         reactor{ false };          //!< 启用I/O反应器, 空闲线程在epoll_wait中等待, 参见 fiber_io.hpp, 仅支持Linux
+    bool         uring{ false };            //!< 以io_uring执行 io::read_at() 等, 不可用时退化为 blocking() 区域中的同步调用, 仅支持Linux
+    size_t       queue_capacity{ 0 };       //!< 已投递而尚未开始执行的任务数上限, 0则不限制, 参见 pool::try_post()
+    overflow_t   overflow{ overflow_block }; //!< 达到queue_capacity时 post() 的处理方式
+};
+
+class pool;
+class task_group;
+class blocking_scope;
+class schedule_awaiter;
+class pool_executor;
+class task_graph;
+
+namespace detail {
+
+/*!
+ *  可调用对象的返回值或者异常, 暂存到发布时再设置到promise中.
+ */
+template< typename R >
+struct result_slot
+{
+    std::exception_ptr  error;
+    std::optional< R >  value;
+
+    template< typename Fn >
+    void run(Fn&& fn) { value.emplace(fn()); }
+    bool ready() const noexcept { return error || value; }
+    void set_to(boost::fibers::promise< R >& p) { p.set_value(std::move(*value)); }
+};
+
+template< typename R >
+struct result_slot< R& >
+{
+    std::exception_ptr  error;
+    R*                  value{ nullptr };
+
+    template< typename Fn >
+    void run(Fn&& fn) { value = &fn(); }
+    bool ready() const noexcept { return error || value; }
+    void set_to(boost::fibers::promise< R& >& p) { p.set_value(*value); }
+};
+
+template<>
+struct result_slot< void >
+{
+    std::exception_ptr  error;
+    bool                value{ false };
+
+    template< typename Fn >
+    void run(Fn&& fn) { fn(); value = true; }
+    bool ready() const noexcept { return error || value; }
+    void set_to(boost::fibers::promise< void >& p) { p.set_value(); }
+};
+
+/*!
+ *  @brief future的后续操作列表
+ *
+ *  与一个future的共享状态分配在一起(见 continuation_allocator), 由结果的生产者在发布结果
+ *  (或者丢弃任务)之后, 销毁promise之前调用 fire(), 依次执行已登记的后续操作; fire() 之后
+ *  登记的后续操作则立即在登记者中执行. 列表是一个无锁的单链表, 登记与触发均只需一次原子操作.
+ */
+class continuation_list
+{
+public:
+    class callback
+    {
+        friend class continuation_list;
+        callback* next_{ nullptr };
+    public:
+        virtual ~callback() {}
+        virtual void operator()() noexcept = 0;
+    };
+
+    template< typename Fn >
+    class callback_impl : public callback
+    {
+        Fn fn_;
+    public:
+        explicit callback_impl(Fn&& fn) : fn_(std::move(fn)) {}
+        void operator()() noexcept { fn_(); }
+    };
+
+    template< typename Fn >
+    static std::unique_ptr< callback > make_callback(Fn fn)
+    {
+        return std::unique_ptr< callback >(new callback_impl< Fn >(std::move(fn)));
+    }
+
+    explicit continuation_list(pool* owner) noexcept
+        : owner_(owner)
+    {
+    }
+
+    continuation_list(continuation_list const&) = delete;
+    continuation_list& operator=(continuation_list const&) = delete;
+
+    ~continuation_list()
+    {
+        callback* head = head_.load(boost::memory_order_relaxed);
+        while (head != nullptr && head != fired_tag())
+            delete std::exchange(head, head->next_);
+    }
+
+    // 生产者所属的池, then() 默认将后续任务投递到该池
+    pool* owner() const noexcept
+    {
+        return owner_;
+    }
+
+    void attach(std::unique_ptr< callback > cb) noexcept
+    {
+        callback* head = head_.load(boost::memory_order_acquire);
+        do
+        {
+            if (head == fired_tag())
+            {
+                (*cb)();
+                return;
+            }
+
+            cb->next_ = head;
+        } while (!head_.compare_exchange_weak(head, cb.get(),
+            boost::memory_order_release, boost::memory_order_acquire));
+
+        cb.release();
+    }
+
+    void fire() noexcept
+    {
+        callback* head = head_.exchange(fired_tag(), boost::memory_order_acq_rel);
+
+        // 链表是逆序的, 反转后按照登记的顺序执行
+        callback* list = nullptr;
+        while (head != nullptr)
+        {
+            callback* next = head->next_;
+            head->next_ = list;
+            list = head;
+            head = next;
+        }
+
+        while (list != nullptr)
+        {
+            std::unique_ptr< callback > cb{ std::exchange(list, list->next_) };
+            (*cb)();
+        }
+    }
+
+private:
+    static callback* fired_tag() noexcept
+    {
+        return reinterpret_cast<callback*>(std::uintptr_t(1));
+    }
+
+    pool*                       owner_;
+    boost::atomic< callback* >  head_{ nullptr };
+};
+
+/*!
+ *  @brief 构造promise时使用的分配器, 将后续操作列表与promise的共享状态分配在同一块内存中
+ *
+ *  列表位于共享状态之前, 与共享状态一同释放, 故每个任务不必为列表单独分配内存.
+ *  分配时通过 list 返回列表的位置, 共享状态中保存的分配器副本不会再次分配.
+ */
+template< typename T >
+class continuation_allocator
+{
+    template< typename U >
+    friend class continuation_allocator;
+
+    pool*                owner_;
+    continuation_list**  list_;
+
+    // 列表之后按T的对齐放置共享状态
+    static constexpr std::size_t offset =
+        (sizeof(continuation_list) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+public:
+    typedef T value_type;
+
+    continuation_allocator(pool* owner, continuation_list** list) noexcept
+        : owner_(owner)
+        , list_(list)
+    {
+    }
+
+    template< typename U >
+    continuation_allocator(continuation_allocator< U > const& other) noexcept
+        : owner_(other.owner_)
+        , list_(other.list_)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+            "over-aligned results are not supported");
+        BOOST_ASSERT(n == 1);
+
+        char* block = static_cast<char*>(::operator new(offset + sizeof(T) * n));
+        *list_ = ::new (block) continuation_list(owner_);
+        return reinterpret_cast<T*>(block + offset);
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        char* block = reinterpret_cast<char*>(p) - offset;
+        reinterpret_cast<continuation_list*>(block)->~continuation_list();
+        ::operator delete(block);
+    }
+
+    template< typename U >
+    bool operator==(continuation_allocator< U > const&) const noexcept
+    {
+        return true;
+    }
+
+    template< typename U >
+    bool operator!=(continuation_allocator< U > const&) const noexcept
+    {
+        return false;
+    }
+};
+
+// 构造带有后续操作列表的promise, 列表的位置写入list
+template< typename R >
+boost::fibers::promise< R > make_continuable_promise(pool* owner, continuation_list*& list)
+{
+    return boost::fibers::promise< R >{ std::allocator_arg, continuation_allocator< char >{ owner, &list } };
+}
+
+/*!
+ *  @brief 等待在池中恢复执行的操作, 如挂起的C++20协程
+ *
+ *  由池排队后在驱动纤程中调用 resume(). 对象由排队者持有(如位于协程帧中的等待体), 排队时不分配内存.
+ */
+class resumable
+{
+public:
+    virtual void resume() noexcept = 0;
+
+protected:
+    ~resumable() {}
+};
+
+// 供池与 when_all()/when_any() 访问future的后续操作列表
+struct continuation_access
+{
+    template< typename Future >
+    static continuation_list* of(Future const& f) noexcept
+    {
+        return f.continuations_;
+    }
+};
+
+} // detail
+
+/*!
+ *  @brief 池中的任务返回的future
+ *
+ *  即 boost::fibers::future, 另外支持以 then() 串联后续操作. 后续操作在前驱就绪时才被投递到池中,
+ *  等待期间不占用纤程与纤程栈. 可以隐式地移动转换为 boost::fibers::future, 但转换之后不再支持 then().
+ *
+ *  @see   pool::async(), when_all(), when_any().
+ */
+template< typename R >
+class future : public boost::fibers::future< R >
+{
+    friend struct detail::continuation_access;
+    detail::continuation_list* continuations_{ nullptr };   //!< 位于共享状态中, 仅在 valid() 时有效
+
+public:
+    future() = default;
+    future(future&&) = default;
+    future& operator=(future&&) = default;
+
+    future(boost::fibers::future< R >&& f,
+        detail::continuation_list* continuations) noexcept
+        : boost::fibers::future< R >(std::move(f))
+        , continuations_(continuations)
+    {
+    }
+
+    /*!
+     *  @brief 在本future就绪后, 以 fn(future) 作为任务投递到生产者所属的池中执行
+     *
+     *  @return 后续任务的future, 可以继续串联.
+     *  @note  本future被移动到后续任务中, 之后不再有效. fn接收的future已经就绪, 前驱的异常
+     *         通过其 get() 重新抛出. 池开始清理之后才就绪的前驱, 其后续任务被丢弃并得到broken_promise.
+     *         没有生产者所属的池时(如由空序列组合而来), fn在前驱就绪的线程中直接执行, 不使用任何池.
+     *  @see   pool::async().
+     */
+    template< typename Fn >
+    future< typename std::result_of< typename std::decay< Fn >::type(future) >::type >
+        then(Fn&& fn);
+
+    /*!
+     *  @brief 以指定的优先级投递后续任务.
+     *  @see   then().
+     */
+    template< typename Fn >
+    future< typename std::result_of< typename std::decay< Fn >::type(future) >::type >
+        then(priority_t priority, Fn&& fn);
+};
+
+/*!
+ *  when_any() 的结果, index为首先就绪的future在futures中的位置.
+ */
+template< typename Sequence >
+struct when_any_result
+{
+    size_t   index{ size_t(-1) };
+    Sequence futures;
+};
+
 /*!
  *  纤程池
- *  内部维护多个工作线程使之共享执行所有投递到池中的任务
+ *  内部维护多个工作线程使之共享执行所有投递到池中的任务, 可以同时存在多个相互独立的池.
  */
 class FIBER_POOL_DECL pool
 {
 private:
     FIBER_POOL_DECL_PRIVATE(pool);
 
-    /*!
-     *  可运行对象的抽象
-     */
-    class FIBER_POOL_DECL abstract_runnable
+    /*!
+     *  可运行对象的抽象
+     */
+    class FIBER_POOL_DECL abstract_runnable
+    {
+    public:
+        virtual ~abstract_runnable() {}
+        virtual void operator()() = 0;
+        virtual abstract_runnable* move_to(void* buffer) noexcept = 0; //!< 移动构造到buffer中, 仅用于内联存储
+        virtual void complete() noexcept {}                             //!< 任务计为完成之后调用, 用于发布结果
+                void finish();
+    };
+
+    /*!
+     *  可运行对象的持有者, 较小的闭包直接构造在内部的缓冲区中, 较大的才分配在堆上.
+     *  持有者随纤程的入口函数一起保存在纤程的上下文中(位于纤程栈上), 故投递小闭包时不需要为其分配内存.
+     */
+    class runnable_holder
+    {
+    public:
+        enum { buffer_size = 128 }; //!< 内联存储的容量, 足以容纳async()投递的捕获少量变量的lambda
+
+    private:
+        abstract_runnable*  runnable_{ nullptr };
+        bool                inline_{ false };
+        typename std::aligned_storage< buffer_size >::type buffer_;
+
+    public:
+        runnable_holder() noexcept {}
+        runnable_holder(runnable_holder const&) = delete;
+        runnable_holder& operator=(runnable_holder const&) = delete;
+        runnable_holder& operator=(runnable_holder&&) = delete;
+
+        runnable_holder(runnable_holder&& right) noexcept
+        {
+            if (right.inline_)
+            {
+                runnable_ = right.runnable_->move_to(&buffer_);
+                inline_ = true;
+                right.reset();
+            }
+            else
+            {
+                std::swap(runnable_, right.runnable_);
+            }
+        }
+
+        ~runnable_holder()
+        {
+            reset();
+        }
+
+        // 移动时不能抛出异常的闭包才内联存储, 否则持有者无法在纤程的上下文之间安全转移
+        template< typename Runnable, typename ... Arg >
+        void emplace(Arg&& ... arg)
+        {
+            reset();
+
+            if constexpr (sizeof(Runnable) <= sizeof(buffer_) &&
+                alignof(Runnable) <= alignof(decltype(buffer_)) &&
+                std::is_nothrow_move_constructible< Runnable >::value)
+            {
+                runnable_ = new (&buffer_) Runnable(std::forward< Arg >(arg) ...);
+                inline_ = true;
+            }
+            else
+            {
+                runnable_ = new Runnable(std::forward< Arg >(arg) ...);
+            }
+        }
+
+        void reset() noexcept
+        {
+            if (inline_)
+                runnable_->~abstract_runnable();
+            else
+                delete runnable_;
+
+            runnable_ = nullptr;
+            inline_ = false;
+        }
+
+        void operator()()
+        {
+            (*runnable_)();
+        }
+
+        void complete() noexcept
+        {
+            runnable_->complete();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return runnable_ != nullptr;
+        }
+    };
+
+    /*!
+     *  @brief async()投递的可调用对象
+     *
+     *  类似于packaged_task, 但执行时只暂存结果, 直到任务计为完成之后才通过 publish() 设置到future中,
+     *  故future就绪时 fiber_count() 已经不再包含该任务. 未被执行的任务析构时future得到broken_promise.
+     */
+    template< typename R, typename Fn >
+    class deferred_task
+    {
+        detail::continuation_list*       continuations_{ nullptr };  //!< 与promise的共享状态分配在一起
+        typename std::decay< Fn >::type  fn_;
+        boost::fibers::promise< R >      promise_;
+        detail::result_slot< R >         slot_;
+        bool                             published_{ false };
+    public:
+        deferred_task(pool* owner, Fn&& fn)
+            : fn_(std::forward< Fn >(fn))
+            , promise_(detail::make_continuable_promise< R >(owner, continuations_))
+        {
+        }
+
+        deferred_task(deferred_task&& other)
+            : continuations_(std::exchange(other.continuations_, nullptr))
+            , fn_(std::move(other.fn_))
+            , promise_(std::move(other.promise_))
+            , slot_(std::move(other.slot_))
+            , published_(other.published_)
+        {
+        }
+
+        // 未发布结果时future先得到broken_promise, 再在promise销毁之前触发后续操作
+        ~deferred_task()
+        {
+            if (continuations_ != nullptr)
+            {
+                if (!published_)
+                    promise_.set_exception(std::make_exception_ptr(boost::fibers::broken_promise{}));
+
+                continuations_->fire();
+            }
+        }
+
+        future< R > get_future()
+        {
+            return future< R >{ promise_.get_future(), continuations_ };
+        }
+
+        template< typename ... Args >
+        void operator()(Args&& ... args)
+        {
+            try
+            {
+                slot_.run([&]() -> R { return fn_(std::forward< Args >(args) ...); });
+            }
+            catch (...)
+            {
+                slot_.error = std::current_exception();
+            }
+        }
+
+        void publish()
+        {
+            if (slot_.error)
+                promise_.set_exception(slot_.error);
+            else if (slot_.ready())
+                slot_.set_to(promise_);
+            else
+                return;
+
+            published_ = true;
+        }
+    };
+
+    /*!
+     *  @brief then()登记的后续操作, 前驱就绪后将后续任务投递到池中
+     *
+     *  登记期间计入池中未决的任务数, 故 shutdown(true) 同样等待尚未投递的后续任务.
+     */
+    template< typename Task, typename Future >
+    class continuation : public detail::continuation_list::callback
+    {
+        struct pending
+        {
+            pool& pool_;
+            explicit pending(pool& p) : pool_(p) { pool_.hold(); }
+            ~pending() { pool_.unhold(); }
+        };
+
+        pending     pending_;   // 最后析构, 使未投递的任务在此之前触发其后续操作
+        priority_t  priority_;
+        Task        task_;
+        Future      pred_;
+    public:
+        continuation(pool& p, priority_t priority, Task&& task, Future&& pred)
+            : pending_(p)
+            , priority_(priority)
+            , task_(std::move(task))
+            , pred_(std::move(pred))
+        {
+        }
+
+        // 池开始清理后不再投递, 后续任务的future得到broken_promise
+        void operator()() noexcept
+        {
+            try
+            {
+                pool& p = pending_.pool_;
+                if (p.state() < cleaning)
+                {
+                    runnable_holder runnable;
+                    runnable.emplace< closure<Task, Future> >(std::move(task_), std::move(pred_));
+                    p.dispatch(std::move(runnable), priority_);
+                }
+            }
+            catch (...)
+            {
+            }
+        }
+    };
+
+    template< typename R >
+    friend class future;
+    friend class task_group;
+    friend class schedule_awaiter;
+    friend class blocking_scope;
+    friend class pool_executor;
+    friend class task_graph;
+
+    /*!
+     *  @brief 排队等待恢复, 由少量的驱动纤程依次调用 resume()
+     *
+     *  驱动纤程与其他纤程共享池的就绪队列, 每个优先级的驱动纤程数不超过工作线程数, 故排队的操作不占用纤程栈.
+     *  @note  池的状态不为running时抛出std::runtime_error, 此时操作未被排队.
+     */
+    void resume_later(detail::resumable* r, priority_t priority);
+
+    void hold() noexcept;
+    void unhold() noexcept;
+
+    /*!
+     *  替换当前纤程(或者线程)的取消标记, 返回原来的标记, 供 task_group 在调用者中执行子任务.
+     *  当前线程使用其他的调度算法时不做任何事并返回nullptr.
+     */
+    static boost::atomic_bool const* exchange_cancellation(boost::atomic_bool const* cancellation) noexcept;
+
+    /*!
+     *  @brief 登记n个即将投递的任务, 参见 pool_options::queue_capacity
+     *
+     *  已满时按 pool_options::overflow 处理, try_only为true时直接返回false. 未限制容量时总是返回true.
+     *  @note  池的状态不为running时抛出std::runtime_error, 此时未登记.
+     */
+    bool admit(size_t n, bool try_only);
+    void unadmit(size_t n) noexcept;
+
+    // 是否设置了 pool_options::queue_capacity
+    bool bounded() const noexcept;
+
+    /*!
+     *  投递时登记的作用域, 投递的任务逐个取走登记, 未取走的部分(如投递中途抛出异常)在析构时撤销.
+     */
+    class admission_scope
+    {
+        pool&  pool_;
+        size_t remaining_;
+    public:
+        admission_scope(pool& p, size_t n)
+            : pool_(p)
+            , remaining_(n)
+        {
+            if (n != 0)
+                pool_.admit(n, false);
+        }
+
+        ~admission_scope()
+        {
+            if (remaining_ != 0)
+                pool_.unadmit(remaining_);
+        }
+
+        // 下一个投递的任务是否已登记
+        bool take() noexcept
+        {
+            if (remaining_ == 0)
+                return false;
+            --remaining_;
+            return true;
+        }
+
+        admission_scope(admission_scope const&) = delete;
+        admission_scope& operator=(admission_scope const&) = delete;
+    };
+
+    /*!
+     *  不经登记的投递, 用于池内部的辅助纤程. 这些纤程被丢弃或者推迟时, 等待它们的纤程将无法推进.
+     */
+    template< typename Fn >
+    fiber post_unbounded(priority_t priority, Fn&& fn)
+    {
+        if (state() != running)
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        runnable_holder runnable;
+        runnable.emplace< closure<Fn> >(std::forward< Fn >(fn));
+
+        return dispatch(std::move(runnable), priority);
+    }
+
+    // 标记工作线程进入或离开阻塞区域, worker为池内部的线程状态
+    void enter_blocking(void* worker) noexcept;
+    void leave_blocking(void* worker) noexcept;
+
+    template< typename R, typename Fn >
+    future< typename std::result_of< typename std::decay< Fn >::type(future< R >) >::type >
+        continue_with(future< R >&& pred, priority_t priority, Fn&& fn)
+    {
+        typedef typename std::result_of<
+            typename std::decay< Fn >::type(future< R >)
+        >::type                                 result_type;
+        typedef deferred_task< result_type, Fn > task_type;
+
+        auto continuations = detail::continuation_access::of(pred);
+
+        task_type task{ this, std::forward< Fn >(fn) };
+        future< result_type > f{ task.get_future() };
+
+        continuations->attach(std::unique_ptr< detail::continuation_list::callback >(
+            new continuation< task_type, future< R > >(*this, priority, std::move(task), std::move(pred))));
+
+        return f;
+    }
+
+    // 前驱没有所属的池时, 在前驱就绪的线程中直接执行后续操作
+    template< typename R, typename Fn >
+    static future< typename std::result_of< typename std::decay< Fn >::type(future< R >) >::type >
+        continue_inline(future< R >&& pred, Fn&& fn)
     {
-    public:
-        virtual ~abstract_runnable() {}
-        virtual void operator()() = 0;
-                void increment();
-                void decrement();
-                void finish();
-        static size_t count();
-    };
+        typedef typename std::result_of<
+            typename std::decay< Fn >::type(future< R >)
+        >::type                                 result_type;
+        typedef deferred_task< result_type, Fn > task_type;
+
+        auto continuations = detail::continuation_access::of(pred);
+
+        task_type task{ nullptr, std::forward< Fn >(fn) };
+        future< result_type > f{ task.get_future() };
+
+        continuations->attach(detail::continuation_list::make_callback(
+            [task = std::move(task), pred = std::move(pred)]() mutable noexcept {
+                task(std::move(pred));
+                task.publish();
+            }));
 
-    typedef std::unique_ptr<abstract_runnable> runnable_ptr;
+        return f;
+    }
 
     /*!
      *  可运行对象的封装, 联合参数一起构成闭包, 可以将其视为一个简易的std::function对象.
@@ -151,28 +913,54 @@ private:
     template< typename Fn, typename ... Arg >
     class closure : public abstract_runnable
     {
-        bool                             inited_{ false };
         typename std::decay< Fn >::type  fn_;
         std::tuple< Arg ... >            arg_;
     public:
         closure() = delete;
         closure(closure const&) = delete;
-        closure(closure &&) = delete;
         closure& operator=(closure const&) = delete;
         closure& operator=(closure&&) = delete;
 
         closure(Fn&& fn, Arg ... arg)
             : fn_(std::forward< Fn >(fn))
             , arg_(std::forward< Arg >(arg) ...)
-            , inited_(true)
         {
-            increment();
         }
 
-        ~closure()
+        closure(closure && right) noexcept(
+            std::is_nothrow_move_constructible< typename std::decay< Fn >::type >::value &&
+            std::is_nothrow_move_constructible< std::tuple< Arg ... > >::value)
+            : fn_(std::move(right.fn_))
+            , arg_(std::move(right.arg_))
+        {
+        }
+
+        abstract_runnable* move_to(void* buffer) noexcept
+        {
+            return new (buffer) closure(std::move(*this));
+        }
+
+        // 可调用对象提供 publish() 时(如 deferred_task), 在任务计为完成之后发布其结果
+        template< typename T >
+        static auto publish(T& fn, int) -> decltype(fn.publish(), void())
+        {
+            fn.publish();
+        }
+
+        template< typename T >
+        static void publish(T&, long)
+        {
+        }
+
+        void complete() noexcept
         {
-            if (inited_)
-                decrement();
+            try
+            {
+                publish(fn_, 0);
+            }
+            catch (...)
+            {
+            }
         }
 
         void operator()()
@@ -200,6 +988,56 @@ private:
         }
     };
 
+    /*!
+     *  批量投递的作用域, 期间在当前线程上投递到本池的纤程被暂存起来,
+     *  析构时一次性放入就绪队列, 并唤醒足够数量的空闲工作线程. enabled为false时不暂存.
+     */
+    class bulk_scope
+    {
+        pool& pool_;
+        bool  active_;
+    public:
+        bulk_scope(pool& p, priority_t priority, size_t hint, bool enabled = true)
+            : pool_(p)
+            , active_(enabled && p.begin_bulk(priority, hint))
+        {
+        }
+
+        ~bulk_scope()
+        {
+            if (active_)
+                pool_.end_bulk();
+        }
+
+        bulk_scope(bulk_scope const&) = delete;
+        bulk_scope& operator=(bulk_scope const&) = delete;
+    };
+
+    // 返回false表示当前线程已经在批量投递, 此时不应调用end_bulk()
+    bool begin_bulk(priority_t priority, size_t hint);
+    void end_bulk() noexcept;
+
+    // 预计的元素个数, 仅用于预留空间, 单遍迭代器返回0
+    template< typename InputIt >
+    static size_t distance_hint(InputIt, InputIt, std::input_iterator_tag)
+    {
+        return 0;
+    }
+
+    template< typename InputIt >
+    static size_t distance_hint(InputIt first, InputIt last, std::forward_iterator_tag)
+    {
+        return static_cast<size_t>(std::distance(first, last));
+    }
+
+    template< typename InputIt >
+    static size_t distance_hint(InputIt first, InputIt last)
+    {
+        return distance_hint(first, last,
+            typename std::iterator_traits< InputIt >::iterator_category());
+    }
+
+public:
     /*!
      *  @brief  实例化池对象
      *
@@ -209,11 +1047,17 @@ private:
     pool(size_t threads = -1);
 
     /*!
-     *  非成员函数, 用于实例化pool对象
+     *  @brief  以指定的配置实例化池对象
+     *
+     *  @note   每个池拥有独立的工作线程与就绪队列, 一个池中的繁重任务不会延误另一个池中的纤程.
+     *          池中的纤程只在该池的工作线程中执行, 从其他线程(包括其他池的工作线程)投递的纤程将转交给该池.
+     *  @see    pool_options.
      */
-    friend FIBER_POOL_DECL pool& get_fiber_pool(size_t threads);
+    pool(const pool_options& options);
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
 
-public:
     ~pool();
 
     enum state_t
@@ -229,15 +1073,31 @@ public:
      */
     state_t state() const noexcept;
 
+    /*!
+     *  当前线程是否为本池的工作线程
+     */
+    bool running_in_this_thread() const noexcept;
+
     /*!
      *  @brief 投递一个可调用对象作为任务到纤程池中执行.
      *
      *  @note  可调用对象抛出的任何异常或返回值都将被丢弃, 若要捕获异常信息或者返回值可以通过
-     *         std::packaged_task包装后再行投递.
-     *  @see   pool::async().
+     *         std::packaged_task包装后再行投递. 设置了 pool_options::queue_capacity 时, 已满则按
+     *         pool_options::overflow 阻塞, 抛出异常或者丢弃最早的任务.
+     *  @see   pool::async(), try_post().
      */
     template<typename Fn, typename ... Arg>
     fiber post(Fn&& fn, Arg ... arg)
+    {
+        return post(normal_priority, std::forward< Fn >(fn), std::forward< Arg >(arg) ...);
+    }
+
+    /*!
+     *  @brief 以指定的优先级投递一个可调用对象到纤程池中执行.
+     *  @see   post().
+     */
+    template<typename Fn, typename ... Arg>
+    fiber post(priority_t priority, Fn&& fn, Arg ... arg)
     {
         // 这里参数不能为: Arg&& ... arg. 这可能导致传递引用类型到closure(), 
         // 从而让其保存了参数的应用而不是拷贝, 在未来使用时即发生未定义行为.
@@ -246,44 +1106,215 @@ public:
         if (state() != running)
             throw std::runtime_error("The task cannot be delivered at this time.");
 
-        return std::move(dispatch(
-            runnable_ptr(new closure<Fn, Arg ...>{ 
-                std::forward< Fn >(fn), std::forward< Arg >(arg) ... })));
+        runnable_holder runnable;
+        runnable.emplace< closure<Fn, Arg ...> >(
+            std::forward< Fn >(fn), std::forward< Arg >(arg) ...);
+
+        admission_scope admission{ *this, 1 };
+        return dispatch(std::move(runnable), priority, nullptr, admission.take());
+    }
+
+    /*!
+     *  @brief 同 post(), 但就绪队列已满(参见 pool_options::queue_capacity)时不投递并返回false, 不阻塞也不丢弃任务.
+     *  @note  池的状态不为running时抛出std::runtime_error.
+     */
+    template<typename Fn, typename ... Arg>
+    bool try_post(Fn&& fn, Arg ... arg)
+    {
+        return try_post(normal_priority, std::forward< Fn >(fn), std::forward< Arg >(arg) ...);
+    }
+
+    /*!
+     *  @brief 以指定的优先级尝试投递.
+     *  @see   try_post().
+     */
+    template<typename Fn, typename ... Arg>
+    bool try_post(priority_t priority, Fn&& fn, Arg ... arg)
+    {
+        if (state() != running)
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        runnable_holder runnable;
+        runnable.emplace< closure<Fn, Arg ...> >(
+            std::forward< Fn >(fn), std::forward< Arg >(arg) ...);
+
+        if (!admit(1, true))
+            return false;
+
+        dispatch(std::move(runnable), priority, nullptr, true);
+        return true;
     }
 
     /*!
      *  @brief 类似于std::async(), 投递可调用对象到池中执行并返回future.
      *
      *  @note  该方法适用于对于只关心结果而不关心执行流程的任务, 若需要关心执行流程,
-     *         比如在某个时候中断任务则建议通过post();
-     *  @see   dispatch().
+     *         比如在某个时候中断任务则建议通过post(); 返回的future可以通过 future::then() 串联后续任务.
+     *  @see   dispatch(), future.
      */
     template< typename Fn, typename ... Args >
-    boost::fibers::future<
+    future<
         typename std::result_of<
         typename std::decay< Fn >::type(typename std::decay< Args >::type ...)
         >::type
     > async(Fn&& fn, Args ... args)
+    {
+        return async(normal_priority, std::forward< Fn >(fn), std::forward< Args >(args) ...);
+    }
+
+    /*!
+     *  @brief 以指定的优先级投递可调用对象到池中执行并返回future.
+     *  @see   async().
+     */
+    template< typename Fn, typename ... Args >
+    future<
+        typename std::result_of<
+        typename std::decay< Fn >::type(typename std::decay< Args >::type ...)
+        >::type
+    > async(priority_t priority, Fn&& fn, Args ... args)
     {
         typedef typename std::result_of<
             typename std::decay< Fn >::type(typename std::decay< Args >::type ...)
         >::type     result_type;
 
-        boost::fibers::packaged_task< result_type(
-            typename std::decay< Args >::type ...) > pt{
-            std::forward< Fn >(fn) };
-        boost::fibers::future< result_type > f{ pt.get_future() };
+        deferred_task< result_type, Fn > task{ this, std::forward< Fn >(fn) };
+        future< result_type > f{ task.get_future() };
 
-        post(std::move(pt), std::forward< Args >(args) ...);
+        post(priority, std::move(task), std::forward< Args >(args) ...);
 
         return f;
     }
 
     /*!
-     *  返回池中所有未决的纤程数.
+     *  @brief 批量投递, 对[first, last)中的每个元素投递一个执行 fn(元素) 的纤程.
+     *
+     *  @note  与逐个调用post()不同, 所有纤程在一个临界区内放入就绪队列, 且只进行一次批量唤醒,
+     *         适用于一次投递大量纤程的场景. 元素与fn均被复制到各自的纤程中.
+     *         设置了 pool_options::queue_capacity 时, 所有元素在投递之前作为一组登记, 就绪队列为空时总是允许;
+     *         单遍迭代器无法预知元素个数, 此时不暂存, 各元素与post()一样逐个登记.
+     *  @see   post().
+     */
+    template< typename InputIt, typename Fn >
+    void post_bulk(InputIt first, InputIt last, Fn fn)
+    {
+        post_bulk(normal_priority, first, last, std::move(fn));
+    }
+
+    /*!
+     *  @brief 以指定的优先级批量投递.
+     *  @see   post_bulk().
+     */
+    template< typename InputIt, typename Fn >
+    void post_bulk(priority_t priority, InputIt first, InputIt last, Fn fn)
+    {
+        typedef typename std::iterator_traits< InputIt >::value_type value_type;
+
+        if (state() != running)
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        size_t hint = distance_hint(first, last);
+
+        // 单遍迭代器不能预先登记, 已满时须像post()一样等待, 而暂存的纤程不会开始执行, 故不暂存
+        bool each = hint == 0 && bounded();
+
+        // 先于暂存登记, 暂存期间不能阻塞
+        admission_scope admission{ *this, hint };
+        bulk_scope scope{ *this, priority, hint, !each };
+        for (; first != last; ++first)
+        {
+            admission_scope single{ *this, size_t(each) };
+
+            runnable_holder runnable;
+            runnable.emplace< closure<Fn&, value_type> >(fn, value_type(*first));
+
+            dispatch(std::move(runnable), priority, nullptr, each ? single.take() : admission.take());
+        }
+    }
+
+    /*!
+     *  @brief 批量版本的async(), 返回的future与[first, last)中的元素一一对应.
+     *  @see   post_bulk(), async().
+     */
+    template< typename InputIt, typename Fn >
+    std::vector< future<
+        typename std::result_of<
+        Fn(typename std::iterator_traits< InputIt >::value_type)
+        >::type
+    > > async_bulk(InputIt first, InputIt last, Fn fn)
+    {
+        return async_bulk(normal_priority, first, last, std::move(fn));
+    }
+
+    /*!
+     *  @brief 以指定的优先级批量投递并返回future.
+     *  @see   async_bulk().
+     */
+    template< typename InputIt, typename Fn >
+    std::vector< future<
+        typename std::result_of<
+        Fn(typename std::iterator_traits< InputIt >::value_type)
+        >::type
+    > > async_bulk(priority_t priority, InputIt first, InputIt last, Fn fn)
+    {
+        typedef typename std::iterator_traits< InputIt >::value_type value_type;
+        typedef typename std::result_of< Fn(value_type) >::type      result_type;
+        typedef deferred_task< result_type, Fn& >                   task_type;
+
+        if (state() != running)
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        size_t hint = distance_hint(first, last);
+        bool each = hint == 0 && bounded();
+
+        std::vector< future< result_type > > futures;
+        futures.reserve(hint);
+
+        admission_scope admission{ *this, hint };
+        bulk_scope scope{ *this, priority, hint, !each };
+        for (; first != last; ++first)
+        {
+            admission_scope single{ *this, size_t(each) };
+
+            task_type pt{ this, fn };
+            futures.emplace_back(pt.get_future());
+
+            runnable_holder runnable;
+            runnable.emplace< closure<task_type, value_type> >(std::move(pt), value_type(*first));
+
+            dispatch(std::move(runnable), priority, nullptr, each ? single.take() : admission.take());
+        }
+
+        return futures;
+    }
+
+    /*!
+     *  @brief 在C++20协程中切换到池中执行: co_await pool.schedule();
+     *
+     *  @note  恢复操作与纤程共享池的就绪队列, 定义在 fiber_coro.hpp 中.
+     *  @see   fiber_pool::task.
+     */
+    schedule_awaiter schedule(priority_t priority = normal_priority) noexcept;
+
+    /*!
+     *  返回池中所有未决的纤程数, 包括已通过 future::then() 登记而前驱尚未就绪的后续任务.
      */
     size_t fiber_count() const noexcept;
 
+    /*!
+     *  返回已投递而尚未开始执行的任务数, 仅在设置了 pool_options::queue_capacity 时统计, 否则返回0.
+     */
+    size_t queued_count() const noexcept;
+
+    /*!
+     *  返回池中正在运行的工作线程数, 允许扩展时随负载变化.
+     */
+    size_t thread_count() const noexcept;
+
+    /*!
+     *  返回当前因没有任务而挂起的工作线程数, 仅作为调度的参考值.
+     */
+    size_t idle_count() const noexcept;
+
     /*!
      *  @brief 停止分派任务并关闭纤程池
      *
@@ -292,29 +1323,277 @@ public:
      *
      *  @note  在等待过程中池的状态将设置为waiting, 而另一种状态是cleaning, 这两种状态均不允许通过dispatch()分派任务,
      *         将抛出std::runtime_error()异常, 返回后池的状态将被设置为stoped.
+     *  @see   shutdown_for().
      */
     void shutdown(bool wait = false) noexcept;
 
+    /*!
+     *  @brief 等待未决的任务执行完毕后关闭纤程池, 但最多等待到deadline
+     *
+     *  @return 所有未决的任务均在deadline之前执行完毕时返回true; 否则超时后池的状态转为cleaning,
+     *          中断剩余的任务并返回false.
+     *  @note  最后一个任务结束时即通知等待者, 故关闭所需的时间等于剩余任务实际的执行时间.
+     *  @see   shutdown().
+     */
+    bool shutdown_until(std::chrono::steady_clock::time_point const& deadline) noexcept;
+
+    /*!
+     *  @brief 同 shutdown_until(), 但最多等待timeout.
+     */
+    template< typename Rep, typename Period >
+    bool shutdown_for(std::chrono::duration< Rep, Period > const& timeout) noexcept
+    {
+        return shutdown_until(std::chrono::steady_clock::now() +
+            std::chrono::duration_cast< std::chrono::steady_clock::duration >(timeout));
+    }
+
 protected:
 
     /*!
      *  @brief 分派可调用对象到纤程池中
      * 
-     *  @param runnable 表示一个可执行对象, 类似一个闭包.
+     *  @param runnable 表示一个可执行对象, 类似一个闭包, 将被移动到纤程的上下文中.
+     *  @param priority 纤程的优先级.
+     *  @param cancellation 共享的取消标记, 被置位后纤程的 this_fiber::interrupted() 返回true, 用于 task_group.
+     *  @param admitted 已通过 admit() 登记, 纤程开始执行时(或未执行即被销毁时)离开登记.
      *  @return 返回指向该未决任务的句柄
      *  @note 如果池的状态state() != running, 将抛出std::runtime_error()异常.
      */
-    fiber dispatch(pool::runnable_ptr&& runnable);
+    fiber dispatch(pool::runnable_holder&& runnable, priority_t priority = normal_priority,
+        boost::atomic_bool const* cancellation = nullptr, bool admitted = false);
 };
 
 /*!
- *  @brief 返回fiber_pool::pool的唯一实例.
+ *  @brief 返回fiber_pool::pool的默认实例.
  *  @param threads 参见pool();
- *  @note  fiber_pool视第一次get_fiber_pool()的调用线程为"主线程", 
- *         fiber_pool承诺fiber绝不会在"主线程"中执行.
+ *  @note  fiber_pool承诺fiber绝不会在池的工作线程之外(如"主线程")执行.
  */
 FIBER_POOL_DECL fiber_pool::pool& get_fiber_pool(size_t threads = -1);
 
+/*!
+ *  @brief 以指定的配置返回fiber_pool::pool的默认实例.
+ *  @note  仅第一次调用时的配置有效, 参见 get_fiber_pool(size_t).
+ */
+FIBER_POOL_DECL fiber_pool::pool& get_fiber_pool(const pool_options& options);
+
+/*!
+ *  @brief 阻塞区域, 生存期内当前工作线程被视为阻塞
+ *
+ *  进入时若池中有排队的纤程, 先唤醒一个挂起的工作线程接手; 没有可唤醒的线程且允许扩展(参见 pool_options::max_threads)时,
+ *  立即补充一个工作线程, 而不是等待负载监视线程的下一次采样. 离开时只撤销标记, 补充的线程空闲超时后自行退出.
+ *
+ *  @note  在非工作线程中构造时不做任何事. 可以嵌套. 绑定到当前线程的纤程无法被其他线程接手.
+ *  @see   blocking().
+ */
+class FIBER_POOL_DECL blocking_scope
+{
+    pool* pool_;
+    void* worker_;
+public:
+    blocking_scope() noexcept;
+    ~blocking_scope();
+
+    blocking_scope(blocking_scope const&) = delete;
+    blocking_scope& operator=(blocking_scope const&) = delete;
+};
+
+/*!
+ *  @brief 在阻塞区域中执行会长时间阻塞线程的同步调用(如阻塞的文件IO或者系统调用), 并返回其结果
+ *
+ *  类似于Go在系统调用期间将调度权交给其他线程, 使排在当前工作线程之后的纤程不被饿死.
+ *  @see   blocking_scope.
+ */
+template< typename Fn >
+decltype(auto) blocking(Fn&& fn)
+{
+    blocking_scope scope;
+    return std::forward< Fn >(fn)();
+}
+
+template< typename R >
+template< typename Fn >
+future< typename std::result_of< typename std::decay< Fn >::type(future< R >) >::type >
+    future< R >::then(Fn&& fn)
+{
+    return then(normal_priority, std::forward< Fn >(fn));
+}
+
+template< typename R >
+template< typename Fn >
+future< typename std::result_of< typename std::decay< Fn >::type(future< R >) >::type >
+    future< R >::then(priority_t priority, Fn&& fn)
+{
+    if (!this->valid() || !continuations_)
+        boost::throw_exception(boost::fibers::future_uninitialized());
+
+    // 没有所属的池时(如由空序列组合而来), 不投递到任何池
+    pool* owner = continuations_->owner();
+    if (owner == nullptr)
+        return pool::continue_inline(std::move(*this), std::forward< Fn >(fn));
+
+    return owner->continue_with(std::move(*this), priority, std::forward< Fn >(fn));
+}
+
+namespace detail {
+
+// 取出[first, last)中的future及其后续操作列表, 有无效的future时抛出future_uninitialized,
+// 此时先检查完整个区间, 不移动任何future
+template< typename InputIt, typename Sequence >
+std::vector< continuation_list* >
+    take_futures(InputIt first, InputIt last, Sequence& futures)
+{
+    std::vector< continuation_list* > lists;
+    for (InputIt it = first; it != last; ++it)
+    {
+        continuation_list* list = continuation_access::of(*it);
+        if (!it->valid() || !list)
+            boost::throw_exception(boost::fibers::future_uninitialized());
+
+        lists.push_back(list);
+    }
+
+    for (; first != last; ++first)
+        futures.push_back(std::move(*first));
+
+    return lists;
+}
+
+} // detail
+
+/*!
+ *  @brief 组合多个future, 所有future均就绪时结果就绪
+ *
+ *  @return 就绪时包含[first, last)中所有(已就绪的)future, 顺序不变.
+ *  @note  [first, last)中的future被移动到结果中, 区间需可以遍历两次; 其中有无效的future时抛出
+ *         future_uninitialized, 且区间保持不变. 组合不占用纤程, 由最后一个就绪的任务直接发布结果.
+ *  @see   future::then(), when_any().
+ */
+template< typename InputIt >
+future< std::vector< typename std::iterator_traits< InputIt >::value_type > >
+    when_all(InputIt first, InputIt last)
+{
+    typedef std::vector< typename std::iterator_traits< InputIt >::value_type > sequence_type;
+
+    struct state_type
+    {
+        sequence_type                                futures;
+        detail::continuation_list*                   continuations{ nullptr };
+        boost::fibers::promise< sequence_type >      promise;
+        boost::atomic_size_t                         pending{ 1 };
+
+        explicit state_type(pool* owner)
+            : promise(detail::make_continuable_promise< sequence_type >(owner, continuations))
+        {
+        }
+
+        // 最后一个到达者发布结果
+        void arrive() noexcept
+        {
+            if (pending.fetch_sub(1) != 1)
+                return;
+
+            try
+            {
+                promise.set_value(std::move(futures));
+            }
+            catch (...)
+            {
+            }
+
+            continuations->fire();
+        }
+    };
+
+    sequence_type futures;
+    auto lists = detail::take_futures(first, last, futures);
+
+    auto state = std::make_shared< state_type >(lists.empty() ? nullptr : lists.front()->owner());
+    state->futures = std::move(futures);
+    future< sequence_type > result{ state->promise.get_future(), state->continuations };
+
+    // 先分配所有回调, 登记过程中不再抛出异常
+    std::vector< std::unique_ptr< detail::continuation_list::callback > > callbacks;
+    for (size_t i = 0; i < lists.size(); ++i)
+        callbacks.push_back(detail::continuation_list::make_callback(
+            [state]() noexcept { state->arrive(); }));
+
+    state->pending += lists.size();
+    for (size_t i = 0; i < lists.size(); ++i)
+        lists[i]->attach(std::move(callbacks[i]));
+
+    state->arrive();
+    return result;
+}
+
+/*!
+ *  @brief 组合多个future, 任意一个future就绪时结果就绪
+ *
+ *  @return 就绪时包含首先就绪的future的位置, 以及[first, last)中所有的future(其余的可能尚未就绪);
+ *          [first, last)为空时立即就绪, 且index为size_t(-1).
+ *  @note  对[first, last)的要求同 when_all().
+ *  @see   when_all().
+ */
+template< typename InputIt >
+future< when_any_result< std::vector< typename std::iterator_traits< InputIt >::value_type > > >
+    when_any(InputIt first, InputIt last)
+{
+    typedef std::vector< typename std::iterator_traits< InputIt >::value_type > sequence_type;
+    typedef when_any_result< sequence_type >                                  result_type;
+
+    struct state_type
+    {
+        sequence_type                                futures;
+        detail::continuation_list*                   continuations{ nullptr };
+        boost::fibers::promise< result_type >        promise;
+        boost::atomic_bool                           done{ false };
+
+        explicit state_type(pool* owner)
+            : promise(detail::make_continuable_promise< result_type >(owner, continuations))
+        {
+        }
+
+        // 第一个到达者发布结果
+        void arrive(size_t index) noexcept
+        {
+            if (done.exchange(true))
+                return;
+
+            try
+            {
+                promise.set_value(result_type{ index, std::move(futures) });
+            }
+            catch (...)
+            {
+            }
+
+            continuations->fire();
+        }
+    };
+
+    sequence_type futures;
+    auto lists = detail::take_futures(first, last, futures);
+
+    auto state = std::make_shared< state_type >(lists.empty() ? nullptr : lists.front()->owner());
+    state->futures = std::move(futures);
+    future< result_type > result{ state->promise.get_future(), state->continuations };
+
+    if (lists.empty())
+    {
+        state->arrive(size_t(-1));
+        return result;
+    }
+
+    std::vector< std::unique_ptr< detail::continuation_list::callback > > callbacks;
+    for (size_t i = 0; i < lists.size(); ++i)
+        callbacks.push_back(detail::continuation_list::make_callback(
+            [state, i]() noexcept { state->arrive(i); }));
+
+    for (size_t i = 0; i < lists.size(); ++i)
+        lists[i]->attach(std::move(callbacks[i]));
+
+    return result;
+}
+
 } // fiber_pool
 
 /*!
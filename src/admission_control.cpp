@@ -0,0 +1,153 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "admission_control.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace fiber_pool {
+
+    bool admission_control::try_acquire(std::size_t n) noexcept
+    {
+        std::size_t count = count_.load();
+        while (count == 0 || count + n <= capacity_)
+        {
+            if (count_.compare_exchange_weak(count, count + n))
+                return true;
+        }
+        return false;
+    }
+
+    bool admission_control::drop_oldest() noexcept
+    {
+        // 先占用丢弃的名额, 被丢弃的纤程结束之前仍占用栈
+        std::size_t dropped = dropped_.load();
+        do
+        {
+            if (dropped >= capacity_)
+                return false;
+        } while (!dropped_.compare_exchange_weak(dropped, dropped + 1));
+
+        std::unique_lock<std::mutex> lk{ tickets_mtx_ };
+        while (!tickets_.empty())
+        {
+            std::shared_ptr<ticket> t = std::move(tickets_.front());
+            tickets_.pop_front();
+
+            if (t->drop())
+            {
+                count_.fetch_sub(1);
+                return true;
+            }
+        }
+
+        dropped_.fetch_sub(1);
+        return false;
+    }
+
+    bool admission_control::acquire(std::size_t n) noexcept
+    {
+        while (!try_acquire(n))
+        {
+            if (policy_ != overflow_drop_oldest || !drop_oldest())
+                return false;
+        }
+        return true;
+    }
+
+    bool admission_control::enter(std::size_t n, bool try_only)
+    {
+        if (capacity_ == 0 || n == 0)
+            return true;
+
+        if (closed_.load(std::memory_order_relaxed))
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        if (try_acquire(n))
+            return true;
+
+        if (try_only)
+            return false;
+
+        if (policy_ == overflow_reject)
+            throw std::runtime_error("The ready queue of the pool is full.");
+
+        // 没有可丢弃的任务(均为尚未创建凭据的并发投递), 或者被丢弃而尚未结束的任务已达到容量时等待
+        if (acquire(n))
+            return true;
+
+        // 先登记为等待者再检查计数, 与 leave() 中先减少计数再检查等待者相对, 不会丢失唤醒
+        std::unique_lock<boost::fibers::mutex> lk{ mtx_ };
+        waiters_.fetch_add(1);
+        cnd_.wait(lk, [this, n]() { return closed_.load() || acquire(n); });
+        waiters_.fetch_sub(1);
+
+        if (closed_.load())
+            throw std::runtime_error("The task cannot be delivered at this time.");
+
+        return true;
+    }
+
+    std::shared_ptr<admission_control::ticket> admission_control::track()
+    {
+        if (policy_ != overflow_drop_oldest)
+            return nullptr;
+
+        auto t = std::make_shared<ticket>();
+
+        std::unique_lock<std::mutex> lk{ tickets_mtx_ };
+
+        // 开始执行的任务只在队首时才及时移除, 高优先级的任务越过了队首的任务时, 其凭据积压到一定数量再清理
+        while (!tickets_.empty() && tickets_.front()->started_or_dropped())
+            tickets_.pop_front();
+
+        if (tickets_.size() >= capacity_ * 2)
+        {
+            tickets_.erase(std::remove_if(tickets_.begin(), tickets_.end(),
+                [](std::shared_ptr<ticket> const& x) { return x->started_or_dropped(); }), tickets_.end());
+        }
+
+        tickets_.push_back(t);
+        return t;
+    }
+
+    void admission_control::leave(std::size_t n/* = 1*/) noexcept
+    {
+        if (capacity_ == 0)
+            return;
+
+        count_.fetch_sub(n);
+        notify();
+    }
+
+    void admission_control::leave_dropped() noexcept
+    {
+        dropped_.fetch_sub(1);
+        notify();
+    }
+
+    void admission_control::notify() noexcept
+    {
+        if (waiters_.load() > 0)
+        {
+            std::unique_lock<boost::fibers::mutex> lk{ mtx_ };
+            cnd_.notify_all();
+        }
+    }
+
+    void admission_control::close() noexcept
+    {
+        if (capacity_ == 0)
+            return;
+
+        // 没有阻塞的投递者时不触及纤程的互斥量, 调用者可能是没有调度器的外部线程.
+        // 先设置标记再检查等待者, 与 enter() 中先登记为等待者再检查标记相对, 不会丢失唤醒
+        closed_.store(true);
+        notify();
+    }
+
+} // fiber_pool
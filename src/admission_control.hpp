@@ -0,0 +1,133 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef admission_control_h__
+#define admission_control_h__
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+#include <boost/fiber/mutex.hpp>
+#include <boost/fiber/condition_variable.hpp>
+
+#include "fiber_pool.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 就绪队列的容量控制, 参见 pool_options::queue_capacity
+ *
+ *  只统计已投递而尚未开始执行的任务: 这些纤程已经分配了栈却还没有推进, 流量突增时正是它们无限堆积.
+ *  任务在纤程开始执行时离开统计, 未执行即被销毁(池清理时)同样离开. 计数为原子变量, 未满时登记与离开均不加锁;
+ *  阻塞的投递者在纤程的条件变量上等待, 故投递者可以是池内的纤程, 也可以是外部线程.
+ *
+ *  丢弃最早的任务时无法将其纤程从调度器的就绪队列中移除, 故每个任务持有一个凭据, 被丢弃的任务开始执行时
+ *  发现凭据已作废, 直接结束而不执行其可调用对象. 被丢弃的任务在其纤程结束之前仍占用栈, 另行计数,
+ *  其数量达到容量时不再丢弃, 投递者与 overflow_block 一样等待, 故纤程与栈的总数不超过容量的两倍.
+ */
+class admission_control : boost::noncopyable
+{
+public:
+    /*!
+     *  任务的凭据, 只在 overflow_drop_oldest 策略下创建
+     */
+    class ticket
+    {
+        enum { queued, started, dropped };
+        std::atomic<int> state_{ queued };
+    public:
+        // 开始执行, 已被丢弃时返回false
+        bool start() noexcept
+        {
+            int expected = queued;
+            return state_.compare_exchange_strong(expected, started);
+        }
+
+        // 丢弃, 已开始执行时返回false
+        bool drop() noexcept
+        {
+            int expected = queued;
+            return state_.compare_exchange_strong(expected, dropped);
+        }
+
+        bool started_or_dropped() const noexcept
+        {
+            return state_.load(std::memory_order_relaxed) != queued;
+        }
+    };
+
+private:
+    std::size_t                               capacity_;
+    overflow_t                                policy_;
+
+    alignas(64) std::atomic<std::size_t>      count_{ 0 };     // 已登记而尚未开始执行的任务数
+    alignas(64) std::atomic<std::size_t>      waiters_{ 0 };   // 阻塞在 enter() 中的投递者数
+    std::atomic<std::size_t>                  dropped_{ 0 };   // 已丢弃而纤程尚未结束的任务数
+    std::atomic<bool>                         closed_{ false };
+
+    boost::fibers::mutex                      mtx_;
+    boost::fibers::condition_variable_any     cnd_;
+
+    std::mutex                                tickets_mtx_;
+    std::deque<std::shared_ptr<ticket>>       tickets_;        // 按投递顺序排列, 队首为最早的任务
+
+    bool try_acquire(std::size_t n) noexcept;
+    bool drop_oldest() noexcept;
+    bool acquire(std::size_t n) noexcept;
+    void notify() noexcept;
+
+public:
+    admission_control(std::size_t capacity, overflow_t policy) noexcept
+        : capacity_(capacity)
+        , policy_(policy)
+    {
+    }
+
+    bool enabled() const noexcept {
+        return capacity_ != 0;
+    }
+
+    std::size_t size() const noexcept {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     *  @brief 登记n个即将投递的任务
+     *
+     *  已满时按策略等待, 抛出std::runtime_error或者丢弃最早的任务; try_only为true时已满直接返回false.
+     *  计数为0时总是允许, 故一次登记超过容量的批量任务不会永远等待. 无任务可丢弃时等待.
+     *  @note  关闭之后抛出std::runtime_error.
+     */
+    bool enter(std::size_t n, bool try_only);
+
+    /*!
+     *  为刚登记的任务创建凭据, 只有 overflow_drop_oldest 策略才需要, 其他策略返回nullptr.
+     */
+    std::shared_ptr<ticket> track();
+
+    /*!
+     *  一个已登记的任务开始执行, 或者未执行即被销毁.
+     */
+    void leave(std::size_t n = 1) noexcept;
+
+    /*!
+     *  一个被丢弃的任务的纤程开始执行(随即结束), 或者未执行即被销毁.
+     */
+    void leave_dropped() noexcept;
+
+    /*!
+     *  池不再接受任务, 唤醒所有阻塞的投递者.
+     */
+    void close() noexcept;
+};
+
+} // fiber_pool
+
+#endif // admission_control_h__
@@ -0,0 +1,64 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "external.hpp"
+
+namespace fiber_pool {
+
+    void external_with_properties::awakened(
+        boost::fibers::context* ctx, fiber_properties& props) noexcept
+    {
+        shared_work_global_config* owner = props.owner();
+
+        if (ctx->is_context(boost::fibers::type::pinned_context) || nullptr == owner)
+        {
+            lqueue_.push_back(*ctx);
+        }
+        else
+        {
+            // 转交给所属的池, 由其工作线程执行
+            ctx->detach();
+            owner->post(ctx, props);
+        }
+    }
+
+    boost::fibers::context* external_with_properties::pick_next() noexcept
+    {
+        boost::fibers::context* ctx = nullptr;
+        if (!lqueue_.empty())
+        {
+            ctx = &lqueue_.front();
+            lqueue_.pop_front();
+        }
+
+        return fiber_properties::run(ctx);
+    }
+
+    bool external_with_properties::has_ready_fibers() const noexcept
+    {
+        return !lqueue_.empty();
+    }
+
+    void external_with_properties::suspend_until(
+        std::chrono::steady_clock::time_point const& time_point) noexcept
+    {
+        std::unique_lock< std::mutex > lk{ mtx_ };
+        if ((std::chrono::steady_clock::time_point::max)() == time_point)
+            cnd_.wait(lk, [this]() { return flag_; });
+        else
+            cnd_.wait_until(lk, time_point, [this]() { return flag_; });
+        flag_ = false;
+    }
+
+    void external_with_properties::notify() noexcept
+    {
+        std::unique_lock< std::mutex > lk{ mtx_ };
+        flag_ = true;
+        lk.unlock();
+        cnd_.notify_all();
+    }
+
+} // fiber_pool
@@ -0,0 +1,58 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef external_h__
+#define external_h__
+
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include "shared_work.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 非工作线程(如主线程)所使用的调度算法
+ *
+ *  通过池创建的纤程在唤醒时被转交给其所属的池, 从而保证池中的纤程绝不会在非工作线程中执行;
+ *  本线程自身的纤程(main context, dispatcher context 以及用户直接创建的纤程)则在本地轮转执行.
+ *
+ *  @note  该算法不引用任何池, 因此安装了它的线程可以向任意多个池投递纤程, 且不受池的生命周期影响.
+ */
+class external_with_properties :
+    public boost::fibers::algo::algorithm_with_properties<fiber_properties>
+{
+    typedef boost::fibers::scheduler::ready_queue_type lqueue_type;
+
+    lqueue_type             lqueue_{};
+    std::mutex              mtx_{};
+    std::condition_variable cnd_{};
+    bool                    flag_{ false };
+
+public:
+    external_with_properties() = default;
+
+    external_with_properties(external_with_properties const&) = delete;
+    external_with_properties(external_with_properties&&) = delete;
+
+    external_with_properties& operator=(external_with_properties const&) = delete;
+    external_with_properties& operator=(external_with_properties&&) = delete;
+
+    void awakened(boost::fibers::context* ctx, fiber_properties& props) noexcept override;
+
+    boost::fibers::context* pick_next() noexcept override;
+
+    bool has_ready_fibers() const noexcept override;
+
+    void suspend_until(std::chrono::steady_clock::time_point const&) noexcept override;
+
+    void notify() noexcept override;
+};
+
+} // fiber_pool
+
+#endif // external_h__
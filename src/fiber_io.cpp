@@ -0,0 +1,233 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include <boost/predef/os.h>
+
+#if !BOOST_OS_WINDOWS
+
+#include "fiber_io.hpp"
+#include "shared_work.hpp"
+
+#include <cerrno>
+#include <algorithm>
+#include <system_error>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fiber_pool {
+
+    // 当前线程所属池的反应器, 非工作线程或者未启用时返回nullptr
+    static reactor* __current_reactor() noexcept
+    {
+        shared_work_global_config* config = shared_work_global_config::current();
+        if (config == nullptr || !config->io().enabled())
+            return nullptr;
+        return &config->io();
+    }
+
+    static void __set_nonblocking(int fd)
+    {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0)
+            throw std::system_error(errno, std::generic_category(), "fcntl");
+
+        if ((flags & O_NONBLOCK) == 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+            throw std::system_error(errno, std::generic_category(), "fcntl");
+    }
+
+    static void __wait(int fd, reactor::event_t event)
+    {
+        if (reactor* io = __current_reactor())
+            return io->wait_ready(fd, event);
+
+        pollfd p{};
+        p.fd = fd;
+        p.events = event == reactor::readable ? POLLIN : POLLOUT;
+
+        blocking_scope scope;
+        while (::poll(&p, 1, -1) < 0)
+        {
+            if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "poll");
+        }
+    }
+
+    // 当前线程所属池的io_uring, 非工作线程或者未启用时返回nullptr
+    static io_ring* __current_ring() noexcept
+    {
+        shared_work_global_config* config = shared_work_global_config::current();
+        if (config == nullptr || !config->ring().enabled())
+            return nullptr;
+        return &config->ring();
+    }
+
+    // 单次读写的上限, 与Linux的 MAX_RW_COUNT 一致
+    static const std::size_t __max_transfer = 0x7ffff000;
+
+    static std::size_t __result(int r, char const* what)
+    {
+        if (r < 0)
+            throw std::system_error(-r, std::generic_category(), what);
+        return static_cast<std::size_t>(r);
+    }
+
+    // 反复调用op直到其不再报告EAGAIN, 返回op的结果
+    template< typename Op >
+    static auto __retry(int fd, reactor::event_t event, char const* what, Op&& op, bool nonblocking = true)
+    {
+        // 没有反应器时描述符保持阻塞, op在阻塞区域中调用, 使排队的纤程由其他线程接手
+        bool blocks = nonblocking && __current_reactor() == nullptr;
+        if (nonblocking && !blocks)
+            __set_nonblocking(fd);
+
+        for (;;)
+        {
+            auto r = blocks ? blocking(op) : op();
+            if (r >= 0)
+                return r;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                __wait(fd, event);
+            else if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+    std::size_t io::async_read(int fd, void* buf, std::size_t n)
+    {
+        return __retry(fd, reactor::readable, "read", [&]() {
+            return ::read(fd, buf, n);
+        });
+    }
+
+    void io::async_write(int fd, void const* buf, std::size_t n)
+    {
+        auto p = static_cast<char const*>(buf);
+        while (n > 0)
+        {
+            auto written = __retry(fd, reactor::writable, "write", [&]() {
+                return ::write(fd, p, n);
+            });
+            p += written;
+            n -= written;
+        }
+    }
+
+    int io::accept(int fd, sockaddr* addr/* = nullptr*/, socklen_t* addrlen/* = nullptr*/)
+    {
+        return __retry(fd, reactor::readable, "accept", [&]() {
+#if BOOST_OS_LINUX
+            return ::accept4(fd, addr, addrlen, SOCK_CLOEXEC);
+#else
+            int s = ::accept(fd, addr, addrlen);
+            if (s >= 0)
+                ::fcntl(s, F_SETFD, FD_CLOEXEC);
+            return s;
+#endif
+        });
+    }
+
+    void io::wait_readable(int fd)
+    {
+        __wait(fd, reactor::readable);
+    }
+
+    void io::wait_writable(int fd)
+    {
+        __wait(fd, reactor::writable);
+    }
+
+    std::size_t io::read_at(int fd, void* buf, std::size_t n, std::uint64_t offset)
+    {
+        n = (std::min)(n, __max_transfer);
+
+        // 提交队列已满时退化为同步调用
+        if (io_ring* ring = __current_ring())
+        {
+            int r = ring->submit(io_ring::op_read, fd, buf, static_cast<std::uint32_t>(n), offset, 0);
+            if (r != -EAGAIN)
+                return __result(r, "read_at");
+        }
+
+        return blocking([&]() {
+            return __retry(fd, reactor::readable, "pread", [&]() {
+                return ::pread(fd, buf, n, static_cast<off_t>(offset));
+            }, false);
+        });
+    }
+
+    void io::write_at(int fd, void const* buf, std::size_t n, std::uint64_t offset)
+    {
+        auto p = static_cast<char const*>(buf);
+        while (n > 0)
+        {
+            std::size_t chunk = (std::min)(n, __max_transfer);
+            std::size_t written;
+
+            io_ring* ring = __current_ring();
+            int r = ring != nullptr ?
+                ring->submit(io_ring::op_write, fd, const_cast<char*>(p), static_cast<std::uint32_t>(chunk), offset, 0) : -EAGAIN;
+
+            if (r != -EAGAIN)
+            {
+                written = __result(r, "write_at");
+            }
+            else
+            {
+                written = blocking([&]() {
+                    return __retry(fd, reactor::writable, "pwrite", [&]() {
+                        return ::pwrite(fd, p, chunk, static_cast<off_t>(offset));
+                    }, false);
+                });
+            }
+
+            if (written == 0)
+                throw std::system_error(EIO, std::generic_category(), "write_at");
+
+            p += written;
+            n -= written;
+            offset += written;
+        }
+    }
+
+    std::size_t io::recv(int fd, void* buf, std::size_t n, int flags/* = 0*/)
+    {
+        n = (std::min)(n, __max_transfer);
+
+        if (io_ring* ring = __current_ring())
+        {
+            int r = ring->submit(io_ring::op_recv, fd, buf, static_cast<std::uint32_t>(n), 0, flags);
+            if (r != -EAGAIN)
+                return __result(r, "recv");
+        }
+
+        // 以MSG_DONTWAIT代替修改描述符的状态
+        return __retry(fd, reactor::readable, "recv", [&]() {
+            return ::recv(fd, buf, n, flags | MSG_DONTWAIT);
+        }, false);
+    }
+
+    std::size_t io::send(int fd, void const* buf, std::size_t n, int flags/* = 0*/)
+    {
+        n = (std::min)(n, __max_transfer);
+
+        if (io_ring* ring = __current_ring())
+        {
+            int r = ring->submit(io_ring::op_send, fd, const_cast<void*>(buf), static_cast<std::uint32_t>(n), 0, flags);
+            if (r != -EAGAIN)
+                return __result(r, "send");
+        }
+
+        return __retry(fd, reactor::writable, "send", [&]() {
+            return ::send(fd, buf, n, flags | MSG_DONTWAIT);
+        }, false);
+    }
+
+} // fiber_pool
+
+#endif // !BOOST_OS_WINDOWS
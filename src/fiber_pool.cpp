@@ -6,45 +6,41 @@
 
 #include "fiber_pool.hpp"
 #include "shared_work.hpp"
+#include "work_stealing.hpp"
+#include "external.hpp"
+#include "stack_pool.hpp"
+#include "sharded_counter.hpp"
+#include "admission_control.hpp"
+#include "topology.hpp"
 
 bool boost::this_fiber::interrupted()
 {
-    if (get_fiber_pool().state() > fiber_pool::pool::waiting)
-        return true;
-
-    return boost::this_fiber::properties<
-        fiber_pool::fiber_properties>().interrupted();
+    // 纤程自身的中断标记与所属池的清理标记, 不访问池对象
+    auto props = fiber_pool::fiber_properties::running();
+    return props != nullptr && props->interruption_requested();
 }
 
 FIBER_POOL_DECL void boost::this_fiber::bind_thread()
 {
+    if (fiber_pool::shared_work_global_config::current() == nullptr)
+        throw std::runtime_error("The fibers can only be bind to the worker thread");
+
     boost::this_fiber::properties<
         fiber_pool::fiber_properties>().bind();
-
-    if (fiber_pool::shared_work_global_config_single::get_const_instance().is_main_thread())
-        throw std::runtime_error("The fibers cannot be bind to the main thread");
 }
 
-//////////////////////////////////////////////////////////////////////////
-
-// pool::abstract_runnable
-static boost::atomic_size_t __abstract_runnable_count{ 0 };
-
-size_t fiber_pool::pool::abstract_runnable::count()
+void fiber_pool::this_fiber::sleep_until(std::chrono::steady_clock::time_point const& time_point)
 {
-    return __abstract_runnable_count;
-}
+    auto config = fiber_pool::shared_work_global_config::current();
+    if (config == nullptr)
+        return boost::this_fiber::sleep_until(time_point);
 
-void fiber_pool::pool::abstract_runnable::increment()
-{
-    ++__abstract_runnable_count;
+    config->timers().sleep_until(time_point);
 }
 
-void fiber_pool::pool::abstract_runnable::decrement()
-{
-    --__abstract_runnable_count;
-}
+//////////////////////////////////////////////////////////////////////////
 
+// pool::abstract_runnable
 void fiber_pool::pool::abstract_runnable::finish()
 {
     boost::this_fiber::properties<
@@ -55,95 +51,324 @@ void fiber_pool::pool::abstract_runnable::finish()
 
 namespace fiber_pool {
 
-struct fiber_private
+// 通过池或者 external_with_properties 创建的纤程, 其属性总是 fiber_properties
+static fiber_properties& properties_of(boost::fibers::context* ctx) noexcept
 {
-    bool interrupt_destruct_{false};
-    boost::fibers::fiber fiber_;
+    return *static_cast<fiber_properties*>(ctx->get_properties());
+}
 
-    fiber_private() {}
+fiber::fiber() noexcept
+{}
 
-    ~fiber_private()
+fiber::fiber(const fiber& right) noexcept
+    : m_context(right.m_context)
+{
+    if (m_context)
+        properties_of(m_context.get()).add_handle();
+}
+
+fiber::fiber(fiber&& right) noexcept
+    : m_context(std::move(right.m_context))
+{}
+
+fiber::fiber(boost::fibers::fiber&& fiber)
+{
+    if (fiber.joinable())
     {
-        if (interrupt_destruct_)
-            fiber_.properties<fiber_properties>().interrupt();
+        // 纤程在构造期间即被唤醒, 此时其属性已经存在
+        auto& props = fiber.properties<fiber_properties>();
+        props.add_handle();
 
-        if (fiber_.joinable())
-            fiber_.detach();
+        m_context.reset(props.context());
+        fiber.detach();
     }
-};
-
-fiber::fiber()
-{}
+}
 
-fiber::fiber(const fiber& right)
-    : m_private(right.m_private)
-{}
+fiber::~fiber()
+{
+    release();
+}
 
-fiber::fiber(boost::fibers::fiber&& fiber)
-    : m_private(std::make_shared<fiber_private>())
+fiber& fiber::operator=(const fiber& right) noexcept
 {
-    m_private->fiber_.swap(fiber);
+    if (m_context != right.m_context)
+    {
+        if (right.m_context)
+            properties_of(right.m_context.get()).add_handle();
+
+        release();
+        m_context = right.m_context;
+    }
+
+    return *this;
 }
 
-fiber& fiber::operator=(const fiber& right)
+fiber& fiber::operator=(fiber&& right) noexcept
 {
-    m_private = right.m_private;
+    if (this != &right)
+    {
+        release();
+        m_context = std::move(right.m_context);
+    }
+
     return *this;
 }
 
+void fiber::release() noexcept
+{
+    if (m_context)
+    {
+        // 须在释放引用之前访问属性, 最后一个引用释放时上下文连同属性一起销毁
+        auto& props = properties_of(m_context.get());
+        if (props.release_handle() && props.interrupt_on_destruct())
+            props.interrupt();
+
+        m_context.reset();
+    }
+}
+
 fiber::id fiber::get_id() const noexcept
 {
-    if (m_private)
-        return m_private->fiber_.get_id();
+    if (m_context)
+        return m_context->get_id();
 
     return fiber::id();
 }
 
 bool fiber::finshed() const noexcept
 {
-    if (m_private)
-    {
-        return const_cast<fiber*>(this)->
-            m_private->fiber_.properties<fiber_properties>().finished();
-    }
+    if (m_context)
+        return properties_of(m_context.get()).finished();
 
     return true;
 }
 
 bool fiber::joinable() const noexcept
 {
-    if (m_private)
-        return m_private->fiber_.joinable();
-
-    return false;
+    return m_context != nullptr;
 }
 
 void fiber::join()
 {
-    if (m_private)
-        m_private->fiber_.join();
+    if (m_context)
+    {
+        if (boost::fibers::context::active() == m_context.get())
+        {
+            throw boost::fibers::fiber_error{
+                std::make_error_code(std::errc::resource_deadlock_would_occur),
+                "boost fiber: trying to join itself" };
+        }
+
+        m_context->join();
+        release();
+    }
 }
 
 void fiber::interrupt()
 {
-    if (m_private)
-        m_private->fiber_.properties<fiber_properties>().interrupt();
+    if (m_context)
+        properties_of(m_context.get()).interrupt();
 }
 
 void fiber::interrupt_on_destruct()
 {
-    if (m_private)
-        m_private->interrupt_destruct_ = true;
+    if (m_context)
+        properties_of(m_context.get()).set_interrupt_on_destruct();
 }
 
 //////////////////////////////////////////////////////////////////////////
 
+// 每个工作线程位置的状态, 扩展出的线程退出后其位置被复用
+struct worker_state
+{
+    alignas(64) boost::atomic_size_t executed{ 0 };     // 已运行的纤程数, 参见 fiber_properties::executed()
+    boost::atomic_bool               active{ false };   // 线程已启动且尚未决定退出
+    boost::atomic_int                blocked{ 0 };      // 正在本线程上执行的阻塞区域数, 参见 blocking_scope
+    boost::atomic_size_t             attached{ 0 };     // 附着于扩展线程的纤程数, 参见 fiber_properties::attached_fibers()
+};
+
+// 当前工作线程的状态, 非工作线程为nullptr
+static thread_local worker_state* __current_worker = nullptr;
+
+// 核心线程与扩展线程分别在各节点之间均分, 使核心线程不会集中在第一个节点
+static std::vector<placement> place_all_workers(affinity_t affinity, size_t core, size_t max)
+{
+    topology topo = topology::current();
+    std::vector<placement> places = place_workers(topo, affinity, core);
+    std::vector<placement> extras = place_workers(topo, affinity, max - core);
+    places.insert(places.end(), extras.begin(), extras.end());
+    return places;
+}
+
+static size_t node_count(std::vector<placement> const& places)
+{
+    size_t nodes = 1;
+    for (auto const& place : places)
+        nodes = (std::max)(nodes, place.node + 1);
+    return nodes;
+}
+
 struct pool_private
 {
+    pool_private(pool& p, const pool_options& o, size_t threads, size_t max_threads)
+        : core_threads(threads)
+        , max_threads(max_threads)
+        , places(place_all_workers(o.affinity, threads, max_threads))
+        , config(p, node_count(places))
+        , stacks(std::make_shared<stack_pool>(o.stack_allocator, o.stack_size, o.stack_cache, max_threads))
+        , admission(o.queue_capacity, o.overflow)
+        , options(o)
+        , threads(max_threads)
+        , workers(new worker_state[max_threads])
+    {
+        for (auto& n : drivers)
+            n.store(0);
+
+        if (o.reactor)
+            config.io().open();
+        if (o.uring)
+            config.ring().open(config.io().enabled() ? config.io().notifier() : -1);
+    }
+
+    size_t                                core_threads; // 常驻的工作线程数
+    size_t                                max_threads;  // 负载升高时最多的工作线程数
+    std::vector<placement>                places;       // 各工作线程的放置, 须先于config初始化
+    shared_work_global_config             config;
+    std::shared_ptr<stack_pool>           stacks;       // 纤程的栈分配器同样持有, 参见 pool_stack_allocator
+    sharded_counter                       fibers;
+    admission_control                     admission;    // 已投递而尚未开始执行的任务, 参见 pool_options::queue_capacity
+    pool_options                          options;
     boost::atomic_int                     pool_state{ pool::stoped };
     boost::mutex                          mutex_stop;
     boost::fibers::condition_variable_any condition_stop;
-    std::vector<boost::thread>            threads;
+    std::vector<boost::thread>            threads;      // 按位置存放, 大小为max_threads
+    std::unique_ptr<worker_state[]>       workers;
+    boost::atomic_size_t                  live_threads{ 0 };
+    std::mutex                            grow_mtx;     // 串行化扩展, 保护 threads 中扩展线程的位置
+    bool                                  grow_stopped{ false };
+    std::vector<boost::thread>            retired;      // 已决定退出而尚未回收的扩展线程, 由 grow_mtx 保护
+
+    std::mutex                            monitor_mtx;
+    std::condition_variable               monitor_cnd;
+    bool                                  monitor_stop{ false };
+    boost::thread                         monitor;      // 负载监视线程, 仅在允许扩展时启动
+
+#if defined(FIBERPOOL_ENABLE_LOCKFREE_QUEUE)
+    typedef multi_level_queue<mpmc_queue<detail::resumable*>, priority_levels> resumable_queue;
+#else
+    typedef multi_level_queue<locked_queue<detail::resumable*>, priority_levels> resumable_queue;
+#endif
+
+    resumable_queue                                    resumables;  // 等待恢复的操作, 参见 pool::resume_later()
+    std::array<boost::atomic_size_t, priority_levels>  drivers;     // 各级别正在运行的驱动纤程数
+
+    void start_worker(size_t i);
+    void run_worker(size_t i);
+    void run_monitor();
+    size_t grow(size_t n) noexcept;
+    void enter_blocking(worker_state& state) noexcept;
+    void reap_retired();
+
+    // 先禁止扩展并停止负载监视线程, 之后不会再有新的工作线程启动
+    void join_workers()
+    {
+        {
+            std::unique_lock<std::mutex> lk{ grow_mtx };
+            grow_stopped = true;
+        }
+        {
+            std::unique_lock<std::mutex> lk{ monitor_mtx };
+            monitor_stop = true;
+        }
+        monitor_cnd.notify_all();
+
+        if (monitor.joinable())
+            monitor.join();
+
+        for (auto& thread : threads)
+        {
+            if (thread.joinable())
+                thread.join();
+        }
+
+        reap_retired();
+    }
+
+    // 转入清理阶段, 中断池中所有的纤程
+    void start_cleaning()
+    {
+        pool_state.store(pool::cleaning);
+        admission.close();
+        config.set_cleaning();
+    }
+
+    // 所有未决的任务均已结束
+    bool drained() const noexcept
+    {
+        return fibers.load() == 0;
+    }
+
+    // 工作线程退出的条件: 正在清理, 或者正在等待且所有未决的任务均已结束
+    bool stopping() const noexcept
+    {
+        int state = pool_state.load();
+        return state > pool::waiting || (state == pool::waiting && drained());
+    }
+
+    void notify_stop()
+    {
+        // 这里需要判断一下, 因为active是静态对象, pool也是静态对象, 故当active先析构时将会出现问题.
+        // GuoJH by 2021-5-21 17:00:09 
+
+        if (boost::fibers::context::active() != nullptr)
+            condition_stop.notify_all();
+    }
+
+    // 驱动纤程数未达到上限时占用一个名额, 否则已有的驱动纤程会取到新排队的操作
+    bool acquire_driver(std::size_t level) noexcept
+    {
+        std::size_t n = drivers[level].load();
+        do
+        {
+            if (n >= (std::max)(live_threads.load(), size_t(1)))
+                return false;
+        } while (!drivers[level].compare_exchange_weak(n, n + 1));
+
+        return true;
+    }
+
+    // 驱动纤程: 依次恢复该级别排队的操作, 队列为空时退出
+    void drive(std::size_t level) noexcept
+    {
+        auto& queue = resumables.at(level);
+        do
+        {
+            std::size_t resumed = 0;
+            while (detail::resumable* r = queue.pop())
+            {
+                r->resume();
+
+                // 定期让出, 使同级的其他纤程不被连续的恢复操作饿死
+                if (++resumed % 64 == 0)
+                    boost::this_fiber::yield();
+            }
+
+            // 先释放名额再检查队列, 与 resume_later() 中先排队再检查名额相对, 避免遗漏
+            drivers[level].fetch_sub(1);
+            boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        } while (!queue.empty() && acquire_driver(level));
+    }
+
+    // 任务结束, 等待关闭期间由最后一个结束的任务通知工作线程以及关闭者
+    void release_fiber()
+    {
+        fibers.decrement();
+        if (pool_state.load() == pool::waiting && drained())
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_stop);
+            notify_stop();
+        }
+    }
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -191,44 +416,294 @@ inline bool set_thread_name(const std::string& name, int thread_id = -1)
 #endif
 
 //////////////////////////////////////////////////////////////////////////
-pool::pool(size_t threads /*= -1*/)
+
+// 每个线程只安装一次调度算法.
+// 若对已经在运行的调度器重复安装, boost::fibers::scheduler::set_algo()会将旧算法
+// 中的就绪纤程逐个转移到新算法, 而共享队列中的纤程将在新旧算法之间反复转移.
+static thread_local bool has_init_algorithm{ false };
+
+// 为工作线程安装所属池的调度算法
+static void use_worker_algorithm(shared_work_global_config& config, scheduling_t scheduling)
 {
-    FIBER_POOL_INIT_PRIVATE(pool);
+    BOOST_ASSERT(!has_init_algorithm);
+    has_init_algorithm = true;
 
-    // 视实例化自己的为主线程
-    shared_work_global_config_single::get_mutable_instance()
-        .set_main_thread(boost::this_thread::get_id());
+    shared_work_global_config::current() = &config;
 
-    // 表示池的状态
-    FIBER_POOL_PRIVATE(pool).pool_state.store(running);
+    switch (scheduling)
+    {
+    case work_stealing:
+        boost::fibers::use_scheduling_algorithm<
+            work_stealing_with_properties>(config, true);
+        break;
+    case shared_work:
+    default:
+        boost::fibers::use_scheduling_algorithm<
+            shared_work_with_properties>(config, true);
+        break;
+    }
+}
 
-    // 默认使用逻辑处理器的2倍
-    if (threads == -1)
-        threads = std::max(boost::thread::hardware_concurrency(), 2u) * 2u;
+// 为投递纤程的非工作线程安装调度算法, 使其创建的纤程转交给所属的池
+static void use_external_algorithm()
+{
+    if (has_init_algorithm)
+        return;
 
-    // 启动工作线程
-    for (size_t i = 0; i < threads; ++i)
+    has_init_algorithm = true;
+
+    boost::fibers::use_scheduling_algorithm<
+        external_with_properties>();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// 负载监视线程的采样周期
+static const std::chrono::milliseconds monitor_interval{ 10 };
+
+void pool_private::start_worker(size_t i)
+{
+    workers[i].active.store(true);
+    live_threads.fetch_add(1);
+
+    try
     {
-        FIBER_POOL_PRIVATE(pool).threads.emplace_back([this, i]()
-        {
+        threads[i] = boost::thread([this, i]() { run_worker(i); });
+    }
+    catch (...)
+    {
+        live_threads.fetch_sub(1);
+        workers[i].active.store(false);
+        throw;
+    }
+}
+
+void pool_private::run_worker(size_t i)
+{
 #if BOOST_OS_WINDOWS
-                set_thread_name("fiberpool - " + std::to_string(i));
+    set_thread_name("fiberpool - " + std::to_string(i));
 #endif
 
-            // 初始化调度算法
-            boost::fibers::use_scheduling_algorithm<
-                shared_work_with_properties>(true);
+    // 限定线程所在的CPU, 并在安装调度算法之前确定所在的节点.
+    // 绑定失败(如CPU被其他cgroup占用)时线程仍可运行, 只是失去了局部性
+    bind_current_thread(places[i].cpus);
+    shared_work_global_config::current_node() = places[i].node;
 
-            // 将线程挂起, 内部会将执行绪交给调度器
-            boost::unique_lock<boost::mutex> lock(FIBER_POOL_PRIVATE(pool).mutex_stop);
-            FIBER_POOL_PRIVATE(pool).condition_stop.wait(lock, [this]() {
-                return FIBER_POOL_PRIVATE(pool).pool_state.load() > running;
-            });
+    // 初始化调度算法
+    use_worker_algorithm(config, options.scheduling);
+
+    // 本线程释放的纤程栈优先缓存在本地
+    stacks->attach_worker(i);
+
+    auto& state = workers[i];
+    fiber_properties::executed() = &state.executed;
+    __current_worker = &state;
+
+    // 将线程挂起, 内部会将执行绪交给调度器
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_stop);
+        if (i < core_threads)
+        {
+            condition_stop.wait(lock, [this]() { return stopping(); });
+        }
+        else
+        {
+            // 扩展出的线程在 idle_timeout 内没有运行任何纤程, 且没有纤程附着于本线程时退出.
+            // 挂起在boost同步原语上的纤程只能在本线程上恢复, 调度器析构时会等待它们结束,
+            // 期间不停地空转, 故须等到它们结束之后才退出
+            fiber_properties::attached_fibers() = &state.attached;
+
+            const std::chrono::milliseconds timeout(options.idle_timeout);
+            for (;;)
+            {
+                size_t executed = state.executed.load(boost::memory_order_relaxed);
+                if (condition_stop.wait_for(lock, timeout, [this]() { return stopping(); }))
+                    break;
+
+                if (state.executed.load(boost::memory_order_relaxed) == executed &&
+                    state.attached.load(boost::memory_order_relaxed) == 0)
+                {
+                    // 此时只有main context在运行, 之后不再接手池中的纤程, 调度器析构时没有需要等待的纤程
+                    shared_work_global_config::retiring() = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    live_threads.fetch_sub(1);
+    state.active.store(false);
 
 #if BOOST_OS_WINDOWS
-            ::OutputDebugStringA("The worker thread exit!\r\n");
+    ::OutputDebugStringA("The worker thread exit!\r\n");
 #endif
-        });
+}
+
+void pool_private::run_monitor()
+{
+    std::vector<size_t> last(max_threads, 0);
+
+    std::unique_lock<std::mutex> lk{ monitor_mtx };
+    while (!monitor_cnd.wait_for(lk, monitor_interval, [this]() { return monitor_stop; }))
+    {
+        lk.unlock();
+        reap_retired();
+        lk.lock();
+
+        // 本周期内没有运行过任何纤程的线程, 或阻塞在系统调用中, 或被长时间运行的纤程占用
+        size_t stalled = 0;
+        for (size_t i = 0; i < max_threads; ++i)
+        {
+            size_t executed = workers[i].executed.load(boost::memory_order_relaxed);
+            if (workers[i].active.load() && (executed == last[i] || workers[i].blocked.load() > 0))
+                ++stalled;
+            last[i] = executed;
+        }
+
+        // 仍有空闲的线程, 或者没有排队的纤程时无需扩展
+        idle_registry& idle = config.idle();
+        if (stalled == 0 || pool_state.load() > pool::waiting ||
+            idle.parked() > 0 || idle.spinning() > 0 || !config.backlogged())
+            continue;
+
+        // 每个周期最多补充与停滞线程数相同的线程
+        lk.unlock();
+        grow(stalled);
+        lk.lock();
+    }
+}
+
+// 启动至多n个扩展线程, 复用已退出的扩展线程的位置, 返回实际启动的线程数
+size_t pool_private::grow(size_t n) noexcept
+{
+    std::unique_lock<std::mutex> lk{ grow_mtx };
+    if (grow_stopped)
+        return 0;
+
+    size_t started = 0;
+    for (size_t i = core_threads; i < max_threads && started < n; ++i)
+    {
+        if (workers[i].active.load())
+            continue;
+
+        // 已决定退出的线程可能尚未结束, 移出其位置而不在锁内等待, 由负载监视线程回收
+        if (threads[i].joinable())
+        {
+            try
+            {
+                retired.push_back(std::move(threads[i]));
+            }
+            catch (...)
+            {
+                break;
+            }
+        }
+
+        try
+        {
+            start_worker(i);
+            ++started;
+        }
+        catch (...)
+        {
+            break;
+        }
+    }
+
+    return started;
+}
+
+// 回收已退出的扩展线程. 决定退出的线程不再接手池中的纤程, 很快就会结束, 在锁外等待
+void pool_private::reap_retired()
+{
+    std::vector<boost::thread> reaped;
+    {
+        std::unique_lock<std::mutex> lk{ grow_mtx };
+        reaped.swap(retired);
+    }
+
+    for (auto& thread : reaped)
+        thread.join();
+}
+
+void pool_private::enter_blocking(worker_state& state) noexcept
+{
+    state.blocked.fetch_add(1);
+
+    if (!config.backlogged())
+        return;
+
+    // 先交给挂起的线程, 已有线程在自旋查找任务时也无需补充
+    idle_registry& idle = config.idle();
+    if (idle.wake_one() || idle.spinning() > 0)
+        return;
+
+    grow(1);
+}
+
+blocking_scope::blocking_scope() noexcept
+    : pool_(nullptr)
+    , worker_(nullptr)
+{
+    shared_work_global_config* config = shared_work_global_config::current();
+    if (config == nullptr || __current_worker == nullptr)
+        return;
+
+    pool_ = &config->pool();
+    worker_ = __current_worker;
+    pool_->enter_blocking(worker_);
+}
+
+blocking_scope::~blocking_scope()
+{
+    if (pool_ != nullptr)
+        pool_->leave_blocking(worker_);
+}
+
+void pool::enter_blocking(void* worker) noexcept
+{
+    FIBER_POOL_PRIVATE(pool).enter_blocking(*static_cast<worker_state*>(worker));
+}
+
+void pool::leave_blocking(void* worker) noexcept
+{
+    static_cast<worker_state*>(worker)->blocked.fetch_sub(1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+pool::pool(size_t threads /*= -1*/)
+    : pool(pool_options{ threads })
+{
+}
+
+pool::pool(const pool_options& options)
+{
+    size_t threads = options.threads;
+
+    // 默认使用逻辑处理器的2倍
+    if (threads == -1)
+        threads = std::max(boost::thread::hardware_concurrency(), 2u) * 2u;
+
+    // 不大于常驻线程数时线程数固定
+    size_t max_threads = (std::max)(threads, options.max_threads);
+
+    FIBER_POOL_INIT_PRIVATE(pool, *this, options, threads, max_threads);
+
+    // 空闲时先自旋, 再让出时间片, 最后挂起
+    FIBER_POOL_PRIVATE(pool).config.idle()
+        .set_policy(static_cast<uint32_t>(options.spin_count), static_cast<uint32_t>(options.yield_count));
+
+    // 表示池的状态
+    FIBER_POOL_PRIVATE(pool).pool_state.store(running);
+
+    // 启动常驻的工作线程, 允许扩展时再启动负载监视线程
+    for (size_t i = 0; i < threads; ++i)
+        FIBER_POOL_PRIVATE(pool).start_worker(i);
+
+    if (max_threads > threads)
+    {
+        pool_private* p = &FIBER_POOL_PRIVATE(pool);
+        p->monitor = boost::thread([p]() { p->run_monitor(); });
     }
 }
 
@@ -251,66 +726,277 @@ pool::state_t pool::state() const noexcept
     return static_cast<state_t>(FIBER_POOL_PRIVATE(pool).pool_state.load());
 }
 
-fiber pool::dispatch(pool::runnable_ptr&& runnable)
+bool pool::running_in_this_thread() const noexcept
+{
+    return shared_work_global_config::current() == &FIBER_POOL_PRIVATE(pool).config;
+}
+
+fiber pool::dispatch(pool::runnable_holder&& runnable, priority_t priority/* = normal_priority*/,
+    boost::atomic_bool const* cancellation/* = nullptr*/, bool admitted/* = false*/)
 {
     // 确保当前线程已经初始化调度算法
-    thread_local static boost::atomic_bool has_not_init_alorithm{ true };
+    use_external_algorithm();
 
-    if (has_not_init_alorithm.load())
+    // 纤程在构造期间即被放入就绪队列, 故需在此之前指定其优先级, 所属的池与取消标记
+    struct initial_properties_scope
     {
-        has_not_init_alorithm.store(false);
+        initial_properties_scope(shared_work_global_config& owner, priority_t priority,
+            boost::atomic_bool const* cancellation) {
+            fiber_properties::initial_owner() = &owner;
+            fiber_properties::initial_priority() = priority;
+            fiber_properties::initial_cancellation() = cancellation;
+        }
+        ~initial_properties_scope() {
+            fiber_properties::initial_owner() = nullptr;
+            fiber_properties::initial_priority() = normal_priority;
+            fiber_properties::initial_cancellation() = nullptr;
+        }
+    } scope{ FIBER_POOL_PRIVATE(pool).config, priority, cancellation };
 
-        boost::fibers::use_scheduling_algorithm<shared_work_with_properties>(true);
-    }
+    // 该对象被移动到纤程的上下文中, 与其持有的闭包一起位于纤程栈上.
+    struct counted_runnable
+    {
+        typedef std::shared_ptr<admission_control::ticket> ticket_ptr;
+
+        runnable_holder runnable;
+        pool_private&   owner;
+        bool            queued;     // 已登记而尚未开始执行
+        ticket_ptr      ticket;     // 仅 overflow_drop_oldest 策略下存在
+
+        counted_runnable(runnable_holder&& r, pool_private& o, bool admitted)
+            : runnable(std::move(r)), owner(o), queued(admitted && o.admission.enabled()) {
+            owner.fibers.increment();
+            if (queued)
+                ticket = owner.admission.track();
+        }
+        counted_runnable(counted_runnable&& right)
+            : runnable(std::move(right.runnable)), owner(right.owner)
+            , queued(std::exchange(right.queued, false)), ticket(std::move(right.ticket)) {
+        }
+        ~counted_runnable() {
+            // 未执行即被销毁
+            start();
+            release();
+        }
+        // 开始执行, 已被丢弃时返回false. 被丢弃的任务此时才离开, 其纤程随即结束
+        bool start() noexcept {
+            if (!std::exchange(queued, false))
+                return true;
+            if (ticket && !ticket->start()) {
+                owner.admission.leave_dropped();
+                return false;
+            }
+            owner.admission.leave();
+            return true;
+        }
+        // 先计为完成再发布结果, 使async()的future就绪时 fiber_count() 已经不再包含该任务
+        void release() noexcept {
+            if (runnable) {
+                owner.release_fiber();
+                runnable.complete();
+                runnable.reset();
+            }
+        }
+        void operator()() {
+            if (start())
+                runnable();
+            release();
+        }
+    };
 
     // 启动
-    return fiber{ boost::fibers::fiber(
-        std::bind(&abstract_runnable::operator(), std::move(runnable))) };
+    return fiber{ boost::fibers::fiber(std::allocator_arg,
+        pool_stack_allocator{ FIBER_POOL_PRIVATE(pool).stacks },
+        counted_runnable{ std::move(runnable), FIBER_POOL_PRIVATE(pool), admitted }) };
+}
+
+bool pool::admit(size_t n, bool try_only)
+{
+    // 阻塞的投递者等待在纤程的条件变量上, 需要当前线程的调度算法
+    use_external_algorithm();
+
+    auto& self = FIBER_POOL_PRIVATE(pool);
+    if (!self.admission.enter(n, try_only))
+        return false;
+
+    // 等待期间池可能已经开始关闭
+    if (state() != running)
+    {
+        self.admission.leave(n);
+        throw std::runtime_error("The task cannot be delivered at this time.");
+    }
+
+    return true;
+}
+
+void pool::unadmit(size_t n) noexcept
+{
+    FIBER_POOL_PRIVATE(pool).admission.leave(n);
+}
+
+boost::atomic_bool const* pool::exchange_cancellation(boost::atomic_bool const* cancellation) noexcept
+{
+    try
+    {
+        // 非工作线程的main context在首次挂起之后才有属性, properties() 会先让出一次
+        use_external_algorithm();
+        return boost::this_fiber::properties<fiber_properties>().exchange_cancellation(cancellation);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void pool::hold() noexcept
+{
+    FIBER_POOL_PRIVATE(pool).fibers.increment();
+}
+
+void pool::unhold() noexcept
+{
+    FIBER_POOL_PRIVATE(pool).release_fiber();
+}
+
+void pool::resume_later(detail::resumable* r, priority_t priority)
+{
+    if (state() != running)
+        throw std::runtime_error("The task cannot be delivered at this time.");
+
+    auto& self = FIBER_POOL_PRIVATE(pool);
+    std::size_t level = fiber_properties::level_of(priority);
+
+    self.resumables.push(r, level);
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    if (!self.acquire_driver(level))
+        return;
+
+    try
+    {
+        post_unbounded(static_cast<priority_t>(level), [&self, level]() { self.drive(level); });
+    }
+    catch (...)
+    {
+        self.drivers[level].fetch_sub(1);
+
+        // 检查状态之后池已转入关闭, 取回排队的操作再抛出, 否则它既不会被恢复也不会被销毁.
+        // 先取出的其他操作的排队者已经返回, 在此就地恢复; 找不到时已被正在运行的驱动纤程取走, 视为成功
+        auto& queue = self.resumables.at(level);
+        while (detail::resumable* x = queue.pop())
+        {
+            if (x == r)
+                throw;
+            x->resume();
+        }
+    }
+}
+
+bool pool::begin_bulk(priority_t priority, size_t hint)
+{
+    // 批量投递期间创建的纤程在当前线程的调度算法中被唤醒, 再转交给本池暂存
+    use_external_algorithm();
+
+    return FIBER_POOL_PRIVATE(pool).config.begin_batch(
+        fiber_properties::level_of(priority), hint);
+}
+
+void pool::end_bulk() noexcept
+{
+    FIBER_POOL_PRIVATE(pool).config.end_batch();
 }
 
 size_t fiber_pool::pool::fiber_count() const noexcept
 {
-    return abstract_runnable::count();
+    return FIBER_POOL_PRIVATE(pool).fibers.load();
+}
+
+size_t pool::queued_count() const noexcept
+{
+    return FIBER_POOL_PRIVATE(pool).admission.size();
+}
+
+bool pool::bounded() const noexcept
+{
+    return FIBER_POOL_PRIVATE(pool).admission.enabled();
+}
+
+size_t pool::thread_count() const noexcept
+{
+    return FIBER_POOL_PRIVATE(pool).live_threads.load();
+}
+
+size_t pool::idle_count() const noexcept
+{
+    return static_cast<size_t>((std::max)(
+        FIBER_POOL_PRIVATE(pool).config.idle().parked(), 0));
 }
 
 void pool::shutdown(bool wait/* = false*/) noexcept
 {
+    if (wait)
+    {
+        shutdown_until((std::chrono::steady_clock::time_point::max)());
+        return;
+    }
+
     // 唤醒退出工作线程
     {
         boost::unique_lock<boost::mutex> lock(FIBER_POOL_PRIVATE(pool).mutex_stop);
-        FIBER_POOL_PRIVATE(pool).pool_state.store(wait ? waiting : cleaning);
+        FIBER_POOL_PRIVATE(pool).start_cleaning();
+        FIBER_POOL_PRIVATE(pool).notify_stop();
+    }
 
-        // 这里需要判断一下, 因为active是静态对象, pool也是静态对象, 故当active先析构时将会出现问题.
-        // GuoJH by 2021-5-21 17:00:09 
+    FIBER_POOL_PRIVATE(pool).join_workers();
 
-        if (boost::fibers::context::active() != nullptr)
-            FIBER_POOL_PRIVATE(pool).condition_stop.notify_all();
-    }
+    FIBER_POOL_PRIVATE(pool).pool_state.store(stoped);
+}
 
-    for (auto& thread : FIBER_POOL_PRIVATE(pool).threads)
+bool pool::shutdown_until(std::chrono::steady_clock::time_point const& deadline) noexcept
+{
+    bool drained = false;
     {
-        if (thread.joinable())
+        boost::unique_lock<boost::mutex> lock(FIBER_POOL_PRIVATE(pool).mutex_stop);
+        FIBER_POOL_PRIVATE(pool).pool_state.store(waiting);
+        FIBER_POOL_PRIVATE(pool).admission.close();
+        FIBER_POOL_PRIVATE(pool).notify_stop();
+
+        // 等待最后一个结束的任务通知, 超时则转为清理, 中断剩余的任务
+        if (boost::fibers::context::active() != nullptr)
         {
-            while (!thread.try_join_for(boost::chrono::milliseconds(100)))
-            {
-                if (fiber_count() == 0)
-                {
-                    boost::unique_lock<boost::mutex> lock(FIBER_POOL_PRIVATE(pool).mutex_stop);
-                    FIBER_POOL_PRIVATE(pool).pool_state.store(cleaning);
+            drained = FIBER_POOL_PRIVATE(pool).condition_stop.wait_until(lock, deadline, [this]() {
+                return FIBER_POOL_PRIVATE(pool).drained();
+            });
+        }
+        else
+        {
+            drained = FIBER_POOL_PRIVATE(pool).drained();
+        }
 
-                    if (boost::fibers::context::active() != nullptr)
-                        FIBER_POOL_PRIVATE(pool).condition_stop.notify_all();
-                }
-            }
+        if (!drained)
+        {
+            FIBER_POOL_PRIVATE(pool).start_cleaning();
+            FIBER_POOL_PRIVATE(pool).notify_stop();
         }
     }
 
+    FIBER_POOL_PRIVATE(pool).join_workers();
+
     FIBER_POOL_PRIVATE(pool).pool_state.store(stoped);
+    return drained;
 }
 
 fiber_pool::pool& get_fiber_pool(size_t threads/* = -1*/)
 {
-    static fiber_pool::pool _pool{ threads };
+    pool_options options;
+    options.threads = threads;
+
+    return get_fiber_pool(options);
+}
+
+fiber_pool::pool& get_fiber_pool(const pool_options& options)
+{
+    static fiber_pool::pool _pool{ options };
     return _pool;
 }
 
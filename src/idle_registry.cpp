@@ -0,0 +1,257 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "idle_registry.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+
+#include <boost/thread/thread.hpp>
+#include <boost/fiber/detail/cpu_relax.hpp>
+
+namespace fiber_pool {
+
+    idle_registry::idle_registry()
+        : max_spinning_(static_cast<int>(boost::thread::hardware_concurrency() / 2))
+    {
+    }
+
+    idle_registry::~idle_registry()
+    {
+        for (auto& chunk : chunks_)
+            delete[] chunk.load();
+    }
+
+    uint32_t idle_registry::acquire()
+    {
+        std::unique_lock< std::mutex > lk{ mutex_ };
+
+        uint32_t index = 0;
+        if (!free_.empty())
+        {
+            index = free_.back();
+            free_.pop_back();
+        }
+        else
+        {
+            if (allocated_ == chunk_size * max_chunks)
+                throw std::runtime_error("Too many scheduling algorithm instances");
+
+            index = allocated_++;
+            if (index % chunk_size == 0)
+                chunks_[index / chunk_size].store(new slot[chunk_size], std::memory_order_release);
+        }
+
+        // 复用的槽位可能残留着上一个使用者的唤醒标记
+        slot& s = at(index);
+        std::unique_lock< std::mutex > slk{ s.mtx };
+        s.flag = false;
+
+        return index;
+    }
+
+    void idle_registry::release(uint32_t index)
+    {
+        std::unique_lock< std::mutex > lk{ mutex_ };
+        free_.push_back(index);
+    }
+
+    void idle_registry::set_policy(uint32_t spin_count, uint32_t yield_count) noexcept
+    {
+        spin_count_.store(spin_count, std::memory_order_relaxed);
+        yield_count_.store(yield_count, std::memory_order_relaxed);
+    }
+
+    void idle_registry::push(uint32_t index) noexcept
+    {
+        slot& s = at(index);
+
+        // 已经位于栈中(可能是过期的记录)则不再重复压入, 否则栈将被破坏
+        bool expected = false;
+        if (!s.stacked.compare_exchange_strong(expected, true))
+            return;
+
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t next = 0;
+        do
+        {
+            s.next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            next = (((head >> 32) + 1) << 32) | (index + 1);
+        }
+        while (!head_.compare_exchange_weak(head, next));
+    }
+
+    uint32_t idle_registry::pop() noexcept
+    {
+        uint64_t head = head_.load();
+        for (;;)
+        {
+            uint32_t top = static_cast<uint32_t>(head);
+            if (top == 0)
+                return uint32_t(-1);
+
+            uint64_t next = (((head >> 32) + 1) << 32)
+                | at(top - 1).next.load(std::memory_order_relaxed);
+            if (head_.compare_exchange_weak(head, next))
+                return top - 1;
+        }
+    }
+
+    bool idle_registry::spin(uint32_t index,
+        std::chrono::steady_clock::time_point const& time_point,
+        std::function<bool()> const& has_work) noexcept
+    {
+        slot& s = at(index);
+
+        uint32_t spin_count = spin_count_.load(std::memory_order_relaxed);
+        uint32_t yield_count = yield_count_.load(std::memory_order_relaxed);
+
+        // 自旋的线程过多时只检查一次, 避免线程数多于CPU时相互抢占;
+        // 单核处理器上自旋没有意义, 因为投递者只有在本线程让出CPU后才能运行.
+        if (spinning_.fetch_add(1) >= max_spinning_)
+            spin_count = yield_count = 0;
+
+        bool found = has_work();
+        bool woken = false;
+        for (uint32_t i = 0; !found && i < spin_count + yield_count; ++i)
+        {
+            if (i < spin_count) {
+                cpu_relax();
+            }
+            else {
+                std::this_thread::yield();
+            }
+
+            // 收到通知(如远程唤醒了绑定的纤程)或者休眠的纤程到期
+            if (s.flag.load(std::memory_order_relaxed) ||
+                ((i % 64 == 0 || i >= spin_count) &&
+                    std::chrono::steady_clock::now() >= time_point))
+            {
+                woken = true;
+                break;
+            }
+
+            found = has_work();
+        }
+
+        // 最后一个自旋的线程找到了任务时, 投递者可能因为看到本线程在自旋
+        // 而没有唤醒其他线程, 故由本线程代为唤醒一个.
+        if (spinning_.fetch_sub(1) == 1 && found)
+            wake_one();
+
+        if (woken)
+        {
+            std::unique_lock< std::mutex > lk{ s.mtx };
+            s.flag = false;
+        }
+
+        return found || woken;
+    }
+
+    void idle_registry::park(uint32_t index,
+        std::chrono::steady_clock::time_point const& time_point,
+        std::function<bool()> const& has_work,
+        idle_waiter* waiter/* = nullptr*/) noexcept
+    {
+        slot& s = at(index);
+
+        // 先登记再检查, 与 wake_one() 中先入队再查找空闲线程的顺序相对,
+        // 保证要么投递者看到本线程, 要么本线程看到新投递的任务.
+        s.parked.store(true);
+        push(index);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (has_work())
+        {
+            s.parked.store(false);
+            return;
+        }
+
+        parked_.fetch_add(1, std::memory_order_relaxed);
+        if (waiter != nullptr)
+        {
+            // 在锁内登记等待方式并检查标记, 与 notify() 相对: 要么本线程看到标记,
+            // 要么通知者看到等待方式并中断等待
+            bool woken;
+            {
+                std::unique_lock< std::mutex > lk{ s.mtx };
+                s.waiter = waiter;
+                woken = s.flag.load();
+            }
+
+            if (!woken)
+                waiter->wait(time_point);
+
+            std::unique_lock< std::mutex > lk{ s.mtx };
+            s.waiter = nullptr;
+            s.flag = false;
+        }
+        else
+        {
+            std::unique_lock< std::mutex > lk{ s.mtx };
+            if ((std::chrono::steady_clock::time_point::max)() == time_point)
+                s.cnd.wait(lk, [&s]() { return s.flag.load(); });
+            else
+                s.cnd.wait_until(lk, time_point, [&s]() { return s.flag.load(); });
+            s.flag = false;
+        }
+        parked_.fetch_sub(1, std::memory_order_relaxed);
+
+        s.parked.store(false);
+    }
+
+    void idle_registry::notify(uint32_t index) noexcept
+    {
+        slot& s = at(index);
+
+        std::unique_lock< std::mutex > lk{ s.mtx };
+        s.flag = true;
+        idle_waiter* waiter = s.waiter;
+        lk.unlock();
+        s.cnd.notify_one();
+
+        if (waiter != nullptr)
+            waiter->interrupt();
+    }
+
+    bool idle_registry::wake_one() noexcept
+    {
+        return wake_n(1) == 1;
+    }
+
+    std::size_t idle_registry::wake_n(std::size_t n) noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // 正在自旋的线程会找到这些任务
+        std::size_t spinning = static_cast<std::size_t>(
+            (std::max)(spinning_.load(std::memory_order_seq_cst), 0));
+        if (spinning >= n)
+            return 0;
+
+        std::size_t woken = 0;
+        for (n -= spinning; woken < n;)
+        {
+            uint32_t index = pop();
+            if (index == uint32_t(-1))
+                break;
+
+            slot& s = at(index);
+            s.stacked.store(false);
+
+            // 跳过已经因超时或其他原因醒来的过期记录
+            if (s.parked.load())
+            {
+                notify(index);
+                ++woken;
+            }
+        }
+
+        return woken;
+    }
+
+} // fiber_pool
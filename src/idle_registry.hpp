@@ -0,0 +1,151 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef idle_registry_h__
+#define idle_registry_h__
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+#include <boost/noncopyable.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 挂起时代替条件变量的等待方式, 如在epoll_wait中等待的I/O反应器
+ */
+class idle_waiter
+{
+public:
+    virtual ~idle_waiter() {}
+
+    // 等待直到time_point, 或者 interrupt() 被调用
+    virtual void wait(std::chrono::steady_clock::time_point const& time_point) noexcept = 0;
+
+    // 使正在进行或者即将进行的 wait() 立即返回, 可在任意线程中调用
+    virtual void interrupt() noexcept = 0;
+};
+
+/*!
+ *  @brief 空闲工作线程登记表
+ *
+ *  每个调度算法实例持有一个槽位, 槽位内包含挂起线程所需的互斥量与条件变量.
+ *  准备挂起的工作线程将自己的槽位压入一个无锁栈, 投递纤程时只需弹出一个槽位
+ *  并唤醒它, 而不是通知所有线程; 若有线程正在自旋查找任务, 则不唤醒任何线程.
+ *
+ *  @note  槽位一经分配便不再释放(只会被回收复用), 因此即使对应的算法实例已经析构,
+ *         唤醒一个过期的槽位也是安全的, 代价仅是一次虚假唤醒.
+ */
+class idle_registry : boost::noncopyable
+{
+    struct slot
+    {
+        std::mutex               mtx;
+        std::condition_variable  cnd;
+        std::atomic<bool>        flag{ false };     // 唤醒标记, 修改时需持有mtx
+        std::atomic<bool>        parked{ false };   // 正在(或即将)挂起
+        std::atomic<bool>        stacked{ false };  // 位于空闲栈中
+        std::atomic<uint32_t>    next{ 0 };         // 栈中下一个槽位的索引+1
+        idle_waiter*             waiter{ nullptr }; // 挂起时使用的等待方式, 修改时需持有mtx
+    };
+
+    enum { chunk_size = 64, max_chunks = 1024 };
+
+    std::array<std::atomic<slot*>, max_chunks> chunks_{};
+    std::mutex                  mutex_;
+    std::vector<uint32_t>       free_;
+    uint32_t                    allocated_{ 0 };
+
+    alignas(64) std::atomic<uint64_t> head_{ 0 };     // 高32位为版本号, 低32位为槽位索引+1
+    alignas(64) std::atomic<int>      spinning_{ 0 };  // 正在查找任务的线程数
+    alignas(64) std::atomic<int>      parked_{ 0 };    // 已挂起的线程数
+
+    std::atomic<uint32_t>             spin_count_{ 0 };
+    std::atomic<uint32_t>             yield_count_{ 0 };
+    int                               max_spinning_;   // 允许同时自旋的线程数
+
+    slot& at(uint32_t index) const noexcept {
+        return chunks_[index / chunk_size].load(std::memory_order_acquire)[index % chunk_size];
+    }
+
+    void push(uint32_t index) noexcept;
+    uint32_t pop() noexcept;
+
+public:
+    idle_registry();
+    ~idle_registry();
+
+    /*!
+     *  @brief 设置空闲时的等待策略
+     *
+     *  @param spin_count  挂起前以cpu_relax()自旋检查任务的次数
+     *  @param yield_count 自旋之后, 挂起之前让出时间片检查任务的次数
+     */
+    void set_policy(uint32_t spin_count, uint32_t yield_count) noexcept;
+
+    /*!
+     *  分配与回收槽位, 槽位数达到上限时抛出std::runtime_error异常.
+     */
+    uint32_t acquire();
+    void     release(uint32_t index);
+
+    /*!
+     *  @brief 挂起之前先自旋等待任务
+     *
+     *  按照等待策略先自旋, 再让出时间片, 期间找到任务, 收到通知或者到达time_point时返回true,
+     *  此时调用者不应挂起. 同时自旋的线程数被限制在逻辑CPU的一半以内, 故单核处理器上不会自旋.
+     */
+    bool spin(uint32_t index,
+              std::chrono::steady_clock::time_point const& time_point,
+              std::function<bool()> const& has_work) noexcept;
+
+    /*!
+     *  @brief 登记到空闲栈中, 并挂起当前线程直到被唤醒或者到达time_point
+     *
+     *  @param has_work   登记后再次检查是否有任务, 用于避免丢失唤醒.
+     *  @param waiter     不为nullptr时以 waiter->wait() 代替条件变量挂起, 唤醒时调用 waiter->interrupt().
+     */
+    void park(uint32_t index,
+              std::chrono::steady_clock::time_point const& time_point,
+              std::function<bool()> const& has_work,
+              idle_waiter* waiter = nullptr) noexcept;
+
+    /*!
+     *  唤醒指定槽位的线程
+     */
+    void notify(uint32_t index) noexcept;
+
+    /*!
+     *  @brief 唤醒一个空闲的线程
+     *  @return 若已有线程在自旋查找任务, 或者没有挂起的线程则返回false.
+     */
+    bool wake_one() noexcept;
+
+    /*!
+     *  @brief 为新投递的n个任务唤醒空闲的线程
+     *  @return 实际唤醒的线程数, 正在自旋查找任务的线程会各自找到一个任务, 故相应地少唤醒.
+     */
+    std::size_t wake_n(std::size_t n) noexcept;
+
+    int parked() const noexcept {
+        return parked_.load(std::memory_order_relaxed);
+    }
+
+    int spinning() const noexcept {
+        return spinning_.load(std::memory_order_relaxed);
+    }
+};
+
+} // fiber_pool
+
+#endif // idle_registry_h__
@@ -0,0 +1,413 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "io_ring.hpp"
+
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <csignal>
+
+#include <boost/predef/os.h>
+
+#if BOOST_OS_LINUX && defined(__has_include)
+#   if __has_include(<linux/io_uring.h>)
+#       define FIBERPOOL_HAS_IO_URING
+#   endif
+#endif
+
+#if defined(FIBERPOOL_HAS_IO_URING)
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+#   include <linux/io_uring.h>
+#   include <linux/time_types.h>
+#endif
+
+namespace fiber_pool {
+
+    static std::int64_t __now_ms() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    io_ring::io_ring(idle_registry& idle)
+        : idle_(idle)
+    {
+    }
+
+    io_ring::~io_ring()
+    {
+        close();
+    }
+
+#if defined(FIBERPOOL_HAS_IO_URING)
+
+    static int __io_uring_setup(unsigned entries, io_uring_params* p) noexcept
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    static int __io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+        unsigned flags, void* arg, std::size_t argsz) noexcept
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+    }
+
+    static int __io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) noexcept
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    bool io_ring::open(int notify_fd/* = -1*/) noexcept
+    {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CLAMP;
+
+        fd_ = __io_uring_setup(entries, &p);
+        if (fd_ < 0)
+            return false;
+
+        // 需要带超时的等待(5.11), 以及完成队列溢出时不丢弃事件
+        if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP))
+        {
+            close();
+            return false;
+        }
+
+        sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            sq_len_ = cq_len_ = (std::max)(sq_len_, cq_len_);
+
+        sq_ptr_ = ::mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED)
+        {
+            sq_ptr_ = nullptr;
+            close();
+            return false;
+        }
+
+        cq_ptr_ = single ? sq_ptr_ :
+            ::mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED)
+        {
+            cq_ptr_ = nullptr;
+            close();
+            return false;
+        }
+
+        sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_ptr_);
+        sq_head_    = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_    = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_flags_   = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+        sq_array_   = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        sq_mask_    = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_entries_ = p.sq_entries;
+
+        char* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cqes_    = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+
+        if (notify_fd >= 0 && __io_uring_register(fd_, IORING_REGISTER_EVENTFD, &notify_fd, 1) < 0)
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void io_ring::close() noexcept
+    {
+        if (sqes_ != nullptr)
+            ::munmap(sqes_, sqes_len_);
+        if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_)
+            ::munmap(cq_ptr_, cq_len_);
+        if (sq_ptr_ != nullptr)
+            ::munmap(sq_ptr_, sq_len_);
+        if (fd_ >= 0)
+            ::close(fd_);
+
+        sqes_ = nullptr;
+        sq_ptr_ = cq_ptr_ = nullptr;
+        fd_ = -1;
+    }
+
+    // 取得一个清零的提交队列项, 需持有mtx_. 填写后由调用者发布
+    io_uring_sqe* io_ring::prepare()
+    {
+        unsigned tail = *sq_tail_;
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_)
+        {
+            // 队列已满, 先提交. 不使用SQPOLL, 内核在 io_uring_enter() 返回前已取走提交的项
+            int n = __io_uring_enter(fd_, unsubmitted_, 0, 0, nullptr, 0);
+            if (n > 0)
+                unsubmitted_ -= (std::min)(static_cast<unsigned>(n), unsubmitted_);
+
+            if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_)
+                return nullptr;
+        }
+
+        unsigned index = tail & sq_mask_;
+        sq_array_[index] = index;
+
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void io_ring::flush() noexcept
+    {
+        unsigned n;
+        {
+            std::unique_lock<std::mutex> lk{ mtx_ };
+            n = unsubmitted_;
+            unsubmitted_ = 0;
+            pending_since_.store(0, std::memory_order_relaxed);
+        }
+
+        if (n == 0)
+            return;
+
+        // 提交失败(如完成队列溢出时的EBUSY)的项仍在队列中, 留待下次提交
+        int submitted = __io_uring_enter(fd_, n, 0, 0, nullptr, 0);
+        if (submitted < static_cast<int>(n))
+        {
+            std::unique_lock<std::mutex> lk{ mtx_ };
+            unsubmitted_ += n - static_cast<unsigned>((std::max)(submitted, 0));
+            pending_since_.store(__now_ms(), std::memory_order_relaxed);
+        }
+    }
+
+    int io_ring::submit(op_t op, int fd, void* buf, std::uint32_t len, std::uint64_t offset, int flags) noexcept
+    {
+        static const std::uint8_t opcodes[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_RECV, IORING_OP_SEND };
+
+        ring_waiter w;
+        boost::fibers::detail::spinlock_lock lk{ w.mtx };
+
+        bool full;
+        {
+            std::unique_lock<std::mutex> g{ mtx_ };
+            if (cancelled_)
+                return -ECANCELED;
+
+            io_uring_sqe* sqe = prepare();
+            if (sqe == nullptr)
+                return -EAGAIN;
+
+            sqe->opcode = opcodes[op];
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<std::uintptr_t>(buf);
+            sqe->len = len;
+            sqe->off = op == op_read || op == op_write ? offset : 0;
+            sqe->msg_flags = op == op_recv || op == op_send ? static_cast<std::uint32_t>(flags) : 0;
+            sqe->user_data = reinterpret_cast<std::uintptr_t>(&w);
+
+            __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+            if (unsubmitted_++ == 0)
+                pending_since_.store(__now_ms(), std::memory_order_relaxed);
+
+            inflight_.fetch_add(1);
+            full = unsubmitted_ >= batch_size;
+        }
+
+        if (full)
+            flush();
+
+        w.suspend(lk);
+        return w.result;
+    }
+
+    waiter* io_ring::collect() noexcept
+    {
+        if (!enabled())
+            return nullptr;
+
+        std::int64_t since = pending_since_.load(std::memory_order_relaxed);
+        if (since != 0 && since != __now_ms())
+            flush();
+
+        if (__atomic_load_n(cq_head_, __ATOMIC_RELAXED) == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) &&
+            !(__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+        {
+            return nullptr;
+        }
+
+        if (reaping_.test_and_set(std::memory_order_acquire))
+            return nullptr;
+
+        // 溢出的完成事件只在 io_uring_enter() 中移回完成队列
+        if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+            __io_uring_enter(fd_, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+        waiter* done = nullptr;
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+            if (cqe->user_data == 0)    // 中断与取消请求
+                continue;
+
+            auto w = reinterpret_cast<ring_waiter*>(static_cast<std::uintptr_t>(cqe->user_data));
+            w->result = cqe->res;
+            w->next = done;
+            done = w;
+            inflight_.fetch_sub(1);
+        }
+
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        reaping_.clear(std::memory_order_release);
+        return done;
+    }
+
+    void io_ring::cancel_all() noexcept
+    {
+        if (!enabled())
+            return;
+
+        {
+            std::unique_lock<std::mutex> lk{ mtx_ };
+            cancelled_ = true;
+
+#if defined(IORING_ASYNC_CANCEL_ANY)
+            // 内核(5.19以下)不支持时, 未完成的请求只能等待其自然完成
+            io_uring_sqe* sqe = prepare();
+            if (sqe != nullptr)
+            {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+                __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+                ++unsubmitted_;
+            }
+#endif
+        }
+
+        flush();
+        idle_.wake_one();
+    }
+
+    void io_ring::wait(std::chrono::steady_clock::time_point const& time_point) noexcept
+    {
+        __kernel_timespec ts{};
+        io_uring_getevents_arg arg{};
+        arg.sigmask_sz = _NSIG / 8;
+
+        if ((std::chrono::steady_clock::time_point::max)() != time_point)
+        {
+            auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                time_point - std::chrono::steady_clock::now());
+            if (delta.count() < 0)
+                delta = delta.zero();
+
+            ts.tv_sec = delta.count() / 1000000000;
+            ts.tv_nsec = delta.count() % 1000000000;
+            arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+        }
+
+        // 完成队列中已有事件时立即返回, 事件由随后的 pick_next() 取出
+        __io_uring_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    void io_ring::interrupt() noexcept
+    {
+        // 以一个空请求的完成事件唤醒 io_uring_enter()
+        {
+            std::unique_lock<std::mutex> lk{ mtx_ };
+            io_uring_sqe* sqe = prepare();
+            if (sqe != nullptr)
+            {
+                sqe->opcode = IORING_OP_NOP;
+                __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+                ++unsubmitted_;
+            }
+        }
+
+        flush();
+    }
+
+#else
+
+    bool io_ring::open(int) noexcept
+    {
+        return false;
+    }
+
+    void io_ring::close() noexcept
+    {
+    }
+
+    io_uring_sqe* io_ring::prepare()
+    {
+        return nullptr;
+    }
+
+    void io_ring::flush() noexcept
+    {
+    }
+
+    int io_ring::submit(op_t, int, void*, std::uint32_t, std::uint64_t, int) noexcept
+    {
+        return -ENOSYS;
+    }
+
+    waiter* io_ring::collect() noexcept
+    {
+        return nullptr;
+    }
+
+    void io_ring::cancel_all() noexcept
+    {
+    }
+
+    void io_ring::wait(std::chrono::steady_clock::time_point const&) noexcept
+    {
+    }
+
+    void io_ring::interrupt() noexcept
+    {
+    }
+
+#endif
+
+    bool io_ring::acquire() noexcept
+    {
+        if (!enabled())
+            return false;
+
+        // 提交者的工作线程转入空闲时, 其积累的请求不再等待凑满一批
+        flush();
+
+        if (inflight_.load() == 0)
+            return false;
+
+        bool expected = false;
+        return polling_.compare_exchange_strong(expected, true);
+    }
+
+    void io_ring::release() noexcept
+    {
+        polling_.store(false);
+    }
+
+} // fiber_pool
@@ -0,0 +1,138 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef io_ring_h__
+#define io_ring_h__
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+
+#include "waiter.hpp"
+#include "idle_registry.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 池内所有工作线程共享的io_uring
+ *
+ *  直接使用系统调用, 不依赖liburing. 纤程提交请求后只挂起自身, 请求先放入提交队列, 积累到一批, 提交者的工作线程转入空闲,
+ *  或者距第一个未提交的请求已过1ms时才以一次 io_uring_enter() 提交. 同一时刻只有一个空闲的工作线程以 idle_waiter 的方式
+ *  在 io_uring_enter() 中等待完成事件; 同时启用了 reactor 时, 完成事件也写入其eventfd, 在epoll_wait中等待的线程同样会被唤醒.
+ *  完成队列位于共享内存中, 忙碌的工作线程在 pick_next() 中直接读取, 无需系统调用.
+ *
+ *  @note  仅在Linux(5.11及以上)上可用, 其他情况下 open() 返回false, 由调用者退化为同步调用.
+ */
+class io_ring : public idle_waiter, boost::noncopyable
+{
+public:
+    enum op_t
+    {
+        op_read,    // pread
+        op_write,   // pwrite
+        op_recv,
+        op_send,
+    };
+
+private:
+    enum { entries = 256, batch_size = 32 };
+
+    struct ring_waiter : waiter
+    {
+        int result{ 0 };    // 完成事件的结果, 失败时为-errno
+    };
+
+    idle_registry&                    idle_;
+    int                               fd_{ -1 };
+
+    void*                             sq_ptr_{ nullptr };
+    std::size_t                       sq_len_{ 0 };
+    void*                             cq_ptr_{ nullptr };
+    std::size_t                       cq_len_{ 0 };
+    io_uring_sqe*                     sqes_{ nullptr };
+    std::size_t                       sqes_len_{ 0 };
+
+    // 与内核共享的环形队列的字段
+    unsigned*                         sq_head_{ nullptr };
+    unsigned*                         sq_tail_{ nullptr };
+    unsigned*                         sq_flags_{ nullptr };
+    unsigned*                         sq_array_{ nullptr };
+    unsigned                          sq_mask_{ 0 };
+    unsigned                          sq_entries_{ 0 };
+    unsigned*                         cq_head_{ nullptr };
+    unsigned*                         cq_tail_{ nullptr };
+    io_uring_cqe*                     cqes_{ nullptr };
+    unsigned                          cq_mask_{ 0 };
+
+    std::mutex                        mtx_;                 // 串行化提交队列的写入
+    unsigned                          unsubmitted_{ 0 };    // 已放入提交队列, 尚未提交的请求数
+    bool                              cancelled_{ false };  // 池正在清理, 不再接受新的请求
+
+    alignas(64) std::atomic<int>           inflight_{ 0 };      // 等待完成的纤程数
+    std::atomic<std::int64_t>              pending_since_{ 0 }; // 第一个未提交的请求的时刻, 毫秒, 0表示没有
+    alignas(64) std::atomic<bool>          polling_{ false };   // 有线程正在 io_uring_enter() 中等待
+    std::atomic_flag                       reaping_ = ATOMIC_FLAG_INIT;
+
+    io_uring_sqe* prepare();
+    void flush() noexcept;
+    void close() noexcept;
+
+public:
+    explicit io_ring(idle_registry& idle);
+    ~io_ring();
+
+    /*!
+     *  @brief 创建io_uring
+     *  @param notify_fd 不为-1时, 每个完成事件都向该eventfd写入, 用于唤醒在其他方式中等待的线程.
+     *  @return 内核不支持或者被禁用时返回false.
+     */
+    bool open(int notify_fd = -1) noexcept;
+
+    bool enabled() const noexcept {
+        return fd_ >= 0;
+    }
+
+    /*!
+     *  @brief 提交一个请求并挂起当前纤程直到完成
+     *  @return 与对应的系统调用相同的结果, 失败时为-errno, 池正在清理时为-ECANCELED.
+     *  @note  必须在安装了本库调度算法的工作线程中的纤程内调用, 且 enabled() 为true. 缓冲区在完成之前必须有效.
+     */
+    int submit(op_t op, int fd, void* buf, std::uint32_t len, std::uint64_t offset, int flags) noexcept;
+
+    /*!
+     *  @brief 尝试成为在 io_uring_enter() 中等待的线程, 并提交积累的请求
+     *
+     *  有纤程在等待完成且没有其他线程在等待时返回true, 调用者以本对象为 idle_waiter 挂起, 之后需调用 release().
+     */
+    bool acquire() noexcept;
+    void release() noexcept;
+
+    /*!
+     *  @brief 取出已完成的纤程
+     *
+     *  未提交的请求超过1ms时先提交. 须在工作线程中调用, 参见 shared_work_global_config::poll().
+     */
+    waiter* collect() noexcept;
+
+    /*!
+     *  池转入清理阶段, 取消所有未完成的请求, 等待者以-ECANCELED(或者已部分完成的结果)被唤醒.
+     */
+    void cancel_all() noexcept;
+
+    void wait(std::chrono::steady_clock::time_point const& time_point) noexcept override;
+    void interrupt() noexcept override;
+};
+
+} // fiber_pool
+
+#endif // io_ring_h__
@@ -0,0 +1,239 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef mpmc_queue_h__
+#define mpmc_queue_h__
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <boost/config.hpp>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 基于互斥量的多生产者多消费者队列
+ *
+ *  与 mpmc_queue 接口一致, 用于未启用 FIBERPOOL_ENABLE_LOCKFREE_QUEUE 时.
+ */
+template<typename T>
+class locked_queue : boost::noncopyable
+{
+    static_assert(std::is_pointer<T>::value, "T must be a pointer type");
+
+    std::deque<T>            queue_;
+    std::mutex               mtx_;
+    std::atomic<std::size_t> size_{ 0 };  // 用于无锁地判断是否为空
+
+public:
+    explicit locked_queue(std::size_t /*capacity*/ = 0)
+    {
+    }
+
+    void push(T x)
+    {
+        std::unique_lock< std::mutex > lk{ mtx_ };
+        queue_.push_back(x);
+        size_.store(queue_.size(), std::memory_order_release);
+    }
+
+    // 在一个临界区内放入[first, last)
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last)
+    {
+        std::unique_lock< std::mutex > lk{ mtx_ };
+        queue_.insert(queue_.end(), first, last);
+        size_.store(queue_.size(), std::memory_order_release);
+    }
+
+    // 队列为空时返回nullptr
+    T pop()
+    {
+        if (size_.load(std::memory_order_acquire) == 0)
+            return nullptr;
+
+        std::unique_lock< std::mutex > lk{ mtx_ };
+        if (queue_.empty())
+            return nullptr;
+
+        T x = queue_.front();
+        queue_.pop_front();
+        size_.store(queue_.size(), std::memory_order_release);
+        return x;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_.load(std::memory_order_acquire);
+    }
+};
+
+/*!
+ *  @brief 无锁的多生产者多消费者队列
+ *
+ *  主体是一个有界环形缓冲区, 每个槽位带有序号, 生产者与消费者各自通过一次CAS
+ *  推进位置即可完成入队与出队(参见 Dmitry Vyukov, Bounded MPMC queue).
+ *  环形缓冲区满时退化到受互斥量保护的溢出队列, 故整体上是无界的;
+ *  溢出队列非空期间新元素也进入溢出队列, 以保持先进先出的顺序.
+ */
+template<typename T>
+class mpmc_queue : boost::noncopyable
+{
+    static_assert(std::is_pointer<T>::value, "T must be a pointer type");
+
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        T                        data;
+    };
+
+    std::unique_ptr<cell[]>               buffer_;
+    std::size_t                           mask_;
+    alignas(64) std::atomic<std::size_t>  enqueue_pos_{ 0 };
+    alignas(64) std::atomic<std::size_t>  dequeue_pos_{ 0 };
+
+    alignas(64) std::atomic<std::size_t>  overflow_size_{ 0 };
+    std::deque<T>                         overflow_;
+    std::mutex                            overflow_mtx_;
+
+    bool try_push(T x) noexcept
+    {
+        cell* c = nullptr;
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            c = &buffer_[pos & mask_];
+            std::size_t seq = c->sequence.load(std::memory_order_acquire);
+            std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false; // 已满
+            else
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+
+        c->data = x;
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    T try_pop() noexcept
+    {
+        cell* c = nullptr;
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            c = &buffer_[pos & mask_];
+            std::size_t seq = c->sequence.load(std::memory_order_acquire);
+            std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (dif == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return nullptr; // 为空
+            else
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+
+        T x = c->data;
+        c->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return x;
+    }
+
+public:
+    explicit mpmc_queue(std::size_t capacity = 4096)
+        : buffer_(new cell[capacity])
+        , mask_(capacity - 1)
+    {
+        BOOST_ASSERT(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+
+        for (std::size_t i = 0; i < capacity; ++i)
+            buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    void push(T x)
+    {
+        if (overflow_size_.load(std::memory_order_acquire) == 0 && try_push(x))
+            return;
+
+        std::unique_lock< std::mutex > lk{ overflow_mtx_ };
+        overflow_.push_back(x);
+        overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+
+    // 放入[first, last), 环形缓冲区放不下的部分在一个临界区内放入溢出队列
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last)
+    {
+        if (overflow_size_.load(std::memory_order_acquire) == 0)
+        {
+            for (; first != last && try_push(*first); ++first)
+                ;
+        }
+
+        if (first == last)
+            return;
+
+        std::unique_lock< std::mutex > lk{ overflow_mtx_ };
+        std::size_t n = overflow_.size();
+        overflow_.insert(overflow_.end(), first, last);
+        overflow_size_.fetch_add(overflow_.size() - n, std::memory_order_release);
+    }
+
+    // 队列为空时返回nullptr
+    T pop()
+    {
+        if (T x = try_pop())
+            return x;
+
+        if (overflow_size_.load(std::memory_order_acquire) == 0)
+            return nullptr;
+
+        std::unique_lock< std::mutex > lk{ overflow_mtx_ };
+        if (overflow_.empty())
+            return nullptr;
+
+        T x = overflow_.front();
+        overflow_.pop_front();
+        overflow_size_.fetch_sub(1, std::memory_order_release);
+        return x;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    std::size_t size() const noexcept
+    {
+        std::size_t dequeue = dequeue_pos_.load(std::memory_order_relaxed);
+        std::size_t enqueue = enqueue_pos_.load(std::memory_order_relaxed);
+        std::size_t ring = enqueue > dequeue ? enqueue - dequeue : 0;
+        return ring + overflow_size_.load(std::memory_order_relaxed);
+    }
+};
+
+} // fiber_pool
+
+#endif // mpmc_queue_h__
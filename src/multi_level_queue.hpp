@@ -0,0 +1,143 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef multi_level_queue_h__
+#define multi_level_queue_h__
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/fiber/context.hpp>
+#include <boost/fiber/scheduler.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 多级队列
+ *
+ *  每个优先级对应一个子队列, 取出时从优先级最高的子队列开始查找, 同一级别内保持子队列自身的顺序.
+ *  级别数是编译期常量且很小, 故查找的代价是常数.
+ *
+ *  @note  Queue 需提供 push(T), pop()(为空时返回nullptr), empty() 以及 size(),
+ *         对各子队列的并发访问是否安全取决于 Queue 本身.
+ */
+template<typename Queue, std::size_t Levels>
+class multi_level_queue : boost::noncopyable
+{
+    std::array<Queue, Levels> queues_;
+
+public:
+    typedef decltype(std::declval<Queue&>().pop()) value_type;
+
+    static constexpr std::size_t levels = Levels;
+
+    void push(value_type x, std::size_t level)
+    {
+        BOOST_ASSERT(level < Levels);
+        queues_[level].push(x);
+    }
+
+    // 将[first, last)放入同一级别, 要求 Queue 提供 push_bulk()
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last, std::size_t level)
+    {
+        BOOST_ASSERT(level < Levels);
+        queues_[level].push_bulk(first, last);
+    }
+
+    // 从优先级最高的非空子队列中取出, 全部为空时返回nullptr
+    value_type pop()
+    {
+        for (std::size_t level = Levels; level-- > 0;)
+        {
+            if (value_type x = queues_[level].pop())
+                return x;
+        }
+
+        return nullptr;
+    }
+
+    // 返回优先级最高的非空子队列的级别, 全部为空时返回-1
+    int top_level() const noexcept
+    {
+        for (std::size_t level = Levels; level-- > 0;)
+        {
+            if (!queues_[level].empty())
+                return static_cast<int>(level);
+        }
+
+        return -1;
+    }
+
+    Queue& at(std::size_t level) noexcept
+    {
+        BOOST_ASSERT(level < Levels);
+        return queues_[level];
+    }
+
+    const Queue& at(std::size_t level) const noexcept
+    {
+        BOOST_ASSERT(level < Levels);
+        return queues_[level];
+    }
+
+    bool empty() const noexcept
+    {
+        return top_level() < 0;
+    }
+
+    std::size_t size() const noexcept
+    {
+        std::size_t size = 0;
+        for (auto& q : queues_)
+            size += q.size();
+
+        return size;
+    }
+};
+
+/*!
+ *  @brief 以 multi_level_queue 所需的接口包装纤程的侵入式就绪链表
+ *
+ *  链表中的纤程仍处于链接状态, 可以通过 context::ready_unlink() 移出.
+ */
+class ready_list : boost::noncopyable
+{
+    boost::fibers::scheduler::ready_queue_type queue_{};
+
+public:
+    void push(boost::fibers::context* ctx)
+    {
+        queue_.push_back(*ctx);
+    }
+
+    boost::fibers::context* pop()
+    {
+        if (queue_.empty())
+            return nullptr;
+
+        boost::fibers::context* ctx = &queue_.front();
+        queue_.pop_front();
+        return ctx;
+    }
+
+    bool empty() const noexcept
+    {
+        return queue_.empty();
+    }
+
+    std::size_t size() const noexcept
+    {
+        return queue_.size();
+    }
+};
+
+} // fiber_pool
+
+#endif // multi_level_queue_h__
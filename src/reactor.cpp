@@ -0,0 +1,315 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "reactor.hpp"
+
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+#include <boost/predef/os.h>
+
+#if BOOST_OS_LINUX
+#   include <unistd.h>
+#   include <sys/epoll.h>
+#   include <sys/eventfd.h>
+#endif
+
+namespace fiber_pool {
+
+    reactor::reactor(idle_registry& idle)
+        : idle_(idle)
+    {
+    }
+
+    reactor::~reactor()
+    {
+#if BOOST_OS_LINUX
+        if (evfd_ >= 0)
+            ::close(evfd_);
+        if (epfd_ >= 0)
+            ::close(epfd_);
+#endif
+    }
+
+#if BOOST_OS_LINUX
+
+    void reactor::open()
+    {
+        epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "epoll_create1");
+
+        evfd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (evfd_ < 0)
+        {
+            int error = errno;
+            ::close(epfd_);
+            epfd_ = -1;
+            throw std::system_error(error, std::generic_category(), "eventfd");
+        }
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = evfd_;
+        if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, evfd_, &ev) < 0)
+        {
+            int error = errno;
+            ::close(evfd_);
+            ::close(epfd_);
+            evfd_ = epfd_ = -1;
+            throw std::system_error(error, std::generic_category(), "epoll_ctl");
+        }
+    }
+
+    // 按当前的等待者重新布防, 需持有mtx_. 描述符可能已被关闭并复用, 故登记状态只作为首选的操作
+    void reactor::arm(int fd, entry& e)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLONESHOT;
+        if (e.reader != nullptr)
+            ev.events |= EPOLLIN | EPOLLRDHUP;
+        if (e.writer != nullptr)
+            ev.events |= EPOLLOUT;
+        ev.data.fd = fd;
+
+        int op = e.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (::epoll_ctl(epfd_, op, fd, &ev) < 0)
+        {
+            if (errno != (op == EPOLL_CTL_MOD ? ENOENT : EEXIST))
+                throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+
+            op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+            if (::epoll_ctl(epfd_, op, fd, &ev) < 0)
+                throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+
+        e.registered = true;
+    }
+
+    void reactor::dispatch(int timeout) noexcept
+    {
+        epoll_event events[64];
+        int n = ::epoll_wait(epfd_, events, 64, timeout);
+        if (n <= 0)
+            return;
+
+        std::unique_lock<std::mutex> lk{ mtx_ };
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == evfd_)
+            {
+                std::uint64_t count;
+                while (::read(evfd_, &count, sizeof(count)) > 0)
+                    ;
+                continue;
+            }
+
+            auto it = fds_.find(fd);
+            if (it == fds_.end())
+                continue;
+
+            // 出错或挂断时两类等待者均被唤醒, 由其重试的系统调用报告错误
+            entry& e = it->second;
+            std::uint32_t revents = events[i].events;
+            if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                complete(e.reader, 0);
+            if (revents & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                complete(e.writer, 0);
+
+            if (e.reader != nullptr || e.writer != nullptr)
+            {
+                try
+                {
+                    arm(fd, e);
+                }
+                catch (std::system_error const& error)
+                {
+                    complete(e.reader, error.code().value());
+                    complete(e.writer, error.code().value());
+                }
+            }
+        }
+    }
+
+    void reactor::wait_ready(int fd, event_t event)
+    {
+        io_waiter w;
+        boost::fibers::detail::spinlock_lock lk{ w.mtx };
+        {
+            std::unique_lock<std::mutex> g{ mtx_ };
+            if (cancelled_)
+                throw std::system_error(ECANCELED, std::generic_category(), "The pool is cleaning");
+
+            entry& e = fds_[fd];
+            io_waiter*& slot = event == readable ? e.reader : e.writer;
+            if (slot != nullptr)
+                throw std::system_error(EBUSY, std::generic_category(), "Another fiber is waiting on the descriptor");
+
+            slot = &w;
+            try
+            {
+                arm(fd, e);
+            }
+            catch (...)
+            {
+                slot = nullptr;
+                throw;
+            }
+
+            waiting_.fetch_add(1);
+        }
+
+        // 没有线程在轮询时唤醒一个空闲线程来担任, 本线程可能一直忙于其他纤程而不会挂起
+        if (!polling_.load())
+            idle_.wake_one();
+
+        w.suspend(lk);
+
+        if (w.error != 0)
+            throw std::system_error(w.error, std::generic_category());
+    }
+
+    void reactor::wait(std::chrono::steady_clock::time_point const& time_point) noexcept
+    {
+        int timeout = -1;
+        if ((std::chrono::steady_clock::time_point::max)() != time_point)
+        {
+            auto delta = time_point - std::chrono::steady_clock::now();
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(delta);
+            if (ms < delta)
+                ++ms;
+            timeout = static_cast<int>((std::max)(ms.count(), decltype(ms.count())(0)));
+        }
+
+        dispatch(timeout);
+    }
+
+    void reactor::interrupt() noexcept
+    {
+        std::uint64_t one = 1;
+        ssize_t r = ::write(evfd_, &one, sizeof(one));
+        (void)r;
+    }
+
+#else
+
+    void reactor::open()
+    {
+        throw std::runtime_error("The reactor is only supported on Linux");
+    }
+
+    void reactor::arm(int, entry&)
+    {
+    }
+
+    void reactor::dispatch(int) noexcept
+    {
+    }
+
+    void reactor::wait_ready(int, event_t)
+    {
+        throw std::runtime_error("The reactor is only supported on Linux");
+    }
+
+    void reactor::wait(std::chrono::steady_clock::time_point const&) noexcept
+    {
+    }
+
+    void reactor::interrupt() noexcept
+    {
+    }
+
+#endif
+
+    // 将等待者移入就绪链表, 需持有mtx_
+    void reactor::complete(io_waiter*& w, int error) noexcept
+    {
+        if (w == nullptr)
+            return;
+
+        w->error = error;
+        w->next = ready_;
+        ready_ = w;
+        w = nullptr;
+
+        waiting_.fetch_sub(1);
+        has_ready_.store(true);
+    }
+
+    bool reactor::acquire() noexcept
+    {
+        if (!enabled() || waiting_.load() == 0)
+            return false;
+
+        bool expected = false;
+        return polling_.compare_exchange_strong(expected, true);
+    }
+
+    void reactor::release() noexcept
+    {
+        polling_.store(false);
+    }
+
+    bool reactor::unattended() const noexcept
+    {
+        return waiting_.load() > 0 && !polling_.load();
+    }
+
+    waiter* reactor::collect() noexcept
+    {
+        if (waiting_.load(std::memory_order_relaxed) > 0 && !polling_.load(std::memory_order_relaxed))
+        {
+            std::int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+            bool expected = false;
+            if (now != last_poll_.load(std::memory_order_relaxed) &&
+                polling_.compare_exchange_strong(expected, true))
+            {
+                last_poll_.store(now, std::memory_order_relaxed);
+                dispatch(0);
+                polling_.store(false);
+
+                // 轮询期间 acquire() 失败的空闲线程可能已经挂起, 唤醒一个来接替
+                if (waiting_.load() > 0)
+                    idle_.wake_one();
+            }
+        }
+
+        if (!has_ready_.load(std::memory_order_relaxed))
+            return nullptr;
+
+        std::unique_lock<std::mutex> lk{ mtx_ };
+        waiter* ready = ready_;
+        ready_ = nullptr;
+        has_ready_.store(false);
+        return ready;
+    }
+
+    void reactor::cancel_all() noexcept
+    {
+        if (!enabled())
+            return;
+
+        {
+            std::unique_lock<std::mutex> lk{ mtx_ };
+            cancelled_ = true;
+            for (auto& item : fds_)
+            {
+                complete(item.second.reader, ECANCELED);
+                complete(item.second.writer, ECANCELED);
+            }
+        }
+
+        // 由工作线程在 pick_next() 中取出
+        interrupt();
+        idle_.wake_one();
+    }
+
+} // fiber_pool
@@ -0,0 +1,130 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef reactor_h__
+#define reactor_h__
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+#include <boost/noncopyable.hpp>
+
+#include "waiter.hpp"
+#include "idle_registry.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 池内所有工作线程共享的I/O反应器(epoll)
+ *
+ *  纤程在文件描述符上等待时只挂起自身, 文件描述符以EPOLLONESHOT登记, 每次等待重新布防, 每个描述符上
+ *  同时至多有一个读等待者与一个写等待者. 同一时刻只有一个空闲的工作线程以 idle_waiter 的方式在epoll_wait中挂起,
+ *  投递纤程时通过eventfd将其唤醒; 其余空闲线程仍在条件变量上挂起. 没有空闲线程时, 忙碌的工作线程在 pick_next()
+ *  中每毫秒至多进行一次非阻塞的轮询. 就绪的纤程与到期的睡眠纤程一样, 作为一批放入共享队列.
+ *
+ *  @note  仅在Linux上可用, 其他平台上 open() 抛出异常.
+ */
+class reactor : public idle_waiter, boost::noncopyable
+{
+public:
+    enum event_t
+    {
+        readable,
+        writable,
+    };
+
+private:
+    struct io_waiter : waiter
+    {
+        int error{ 0 };     // 非0时等待失败, 如重新布防失败或者池正在清理
+    };
+
+    struct entry
+    {
+        io_waiter* reader{ nullptr };
+        io_waiter* writer{ nullptr };
+        bool       registered{ false }; // 已加入epoll, 之后以EPOLL_CTL_MOD布防
+    };
+
+    idle_registry&                    idle_;
+    int                               epfd_{ -1 };
+    int                               evfd_{ -1 };     // 用于中断epoll_wait
+
+    std::mutex                        mtx_;
+    std::unordered_map<int, entry>    fds_;
+    waiter*                           ready_{ nullptr };   // 已就绪, 等待唤醒的纤程
+    bool                              cancelled_{ false }; // 池正在清理, 不再接受新的等待
+
+    alignas(64) std::atomic<int>           waiting_{ 0 };       // 登记在描述符上的等待者数
+    alignas(64) std::atomic<bool>          has_ready_{ false };
+    std::atomic<bool>                      polling_{ false };   // 有线程正在epoll_wait中
+    std::atomic<std::int64_t>              last_poll_{ 0 };     // 上次非阻塞轮询的时刻, 毫秒
+
+    void arm(int fd, entry& e);
+    void complete(io_waiter*& w, int error) noexcept;
+    void dispatch(int timeout) noexcept;
+
+public:
+    explicit reactor(idle_registry& idle);
+    ~reactor();
+
+    /*!
+     *  创建epoll与eventfd, 失败时抛出std::system_error异常, 非Linux平台抛出std::runtime_error异常.
+     */
+    void open();
+
+    bool enabled() const noexcept {
+        return epfd_ >= 0;
+    }
+
+    // 中断epoll_wait的eventfd, 供 io_ring 通知完成事件
+    int notifier() const noexcept {
+        return evfd_;
+    }
+
+    /*!
+     *  @brief 挂起当前纤程直到fd可读或者可写
+     *
+     *  描述符上已有同类的等待者, 布防失败(如普通文件不支持epoll), 或者池正在清理时抛出std::system_error异常.
+     *  @note  必须在安装了本库调度算法的工作线程中的纤程内调用, 且 enabled() 为true.
+     */
+    void wait_ready(int fd, event_t event);
+
+    /*!
+     *  @brief 尝试成为在epoll_wait中挂起的线程
+     *
+     *  有纤程在等待且没有其他线程在轮询时返回true, 调用者以本对象为 idle_waiter 挂起, 之后需调用 release().
+     */
+    bool acquire() noexcept;
+    void release() noexcept;
+
+    /*!
+     *  有纤程在等待但没有线程在轮询, 空闲线程挂起前应重新尝试 acquire().
+     */
+    bool unattended() const noexcept;
+
+    /*!
+     *  @brief 取出已就绪的纤程
+     *
+     *  没有线程在epoll_wait中挂起时先进行一次非阻塞的轮询, 每毫秒至多一次. 须在工作线程中调用, 参见 shared_work_global_config::poll().
+     */
+    waiter* collect() noexcept;
+
+    /*!
+     *  池转入清理阶段, 唤醒所有等待者, 其 wait_ready() 抛出 ECANCELED.
+     */
+    void cancel_all() noexcept;
+
+    void wait(std::chrono::steady_clock::time_point const& time_point) noexcept override;
+    void interrupt() noexcept override;
+};
+
+} // fiber_pool
+
+#endif // reactor_h__
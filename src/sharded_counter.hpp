@@ -0,0 +1,88 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef sharded_counter_h__
+#define sharded_counter_h__
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 分片计数器
+ *
+ *  每个线程只修改自己所属的分片, 各分片独占一个缓存行, 故高频的增减不会在核心之间争用同一个缓存行;
+ *  读取时才累加所有分片. 同一个计数可能在一个线程中增加而在另一个线程中减少, 故单个分片可以为负数.
+ *
+ *  @note  读取不是所有分片的原子快照. 但当计数只会减少时(如关闭池的过程中), 读到0即表示确实为0;
+ *         且最后一次减少之后的读取必然能看到之前所有的减少, 故可用于检测计数归零.
+ */
+class sharded_counter : boost::noncopyable
+{
+    struct alignas(64) shard
+    {
+        std::atomic<std::intptr_t> value{ 0 };
+    };
+
+    enum { max_shards = 256 };
+
+    std::unique_ptr<shard[]> shards_;
+    std::size_t              mask_;
+
+    // 线程首次使用时依次分配的序号, 线程数不超过分片数时各线程独占一个分片
+    static std::size_t thread_index() noexcept
+    {
+        static std::atomic<std::size_t> next{ 0 };
+        static thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+public:
+    /*!
+     *  @param shards 分片数, 向上取整为2的幂, 0则使用逻辑CPU数.
+     */
+    explicit sharded_counter(std::size_t shards = 0)
+    {
+        if (shards == 0)
+            shards = boost::thread::hardware_concurrency();
+
+        std::size_t n = 1;
+        while (n < shards && n < max_shards)
+            n <<= 1;
+
+        shards_.reset(new shard[n]);
+        mask_ = n - 1;
+    }
+
+    void increment() noexcept
+    {
+        shards_[thread_index() & mask_].value.fetch_add(1);
+    }
+
+    void decrement() noexcept
+    {
+        shards_[thread_index() & mask_].value.fetch_sub(1);
+    }
+
+    std::size_t load() const noexcept
+    {
+        std::intptr_t sum = 0;
+        for (std::size_t i = 0; i <= mask_; ++i)
+            sum += shards_[i].value.load();
+
+        return sum > 0 ? static_cast<std::size_t>(sum) : 0;
+    }
+};
+
+} // fiber_pool
+
+#endif // sharded_counter_h__
@@ -5,38 +5,113 @@
 // file that was distributed with this source code.
 
 #include "shared_work.hpp"
+#include "work_stealing.hpp"
+
+#include <array>
+#include <algorithm>
 
 namespace fiber_pool {
 
-    void shared_work_global_config::notify_one()
+    // 当前线程上正在进行的批量投递, 暂存空间在线程内复用
+    struct posting_batch
+    {
+        shared_work_global_config* owner{ nullptr };
+        std::array<std::vector<boost::fibers::context*>, priority_levels> levels;
+    };
+
+    static thread_local posting_batch __current_batch;
+
+    void shared_work_global_config::post(
+        boost::fibers::context* ctx, fiber_properties& props)
+    {
+        if (__current_batch.owner == this)
+        {
+            __current_batch.levels[props.level()].push_back(ctx);
+            return;
+        }
+
+        rqueue(post_node()).push(ctx, props.level());
+
+        // 只唤醒一个空闲的工作线程, 若已有线程在自旋查找任务则无需唤醒
+        idle_.wake_one();
+    }
+
+    bool shared_work_global_config::begin_batch(std::size_t level, std::size_t hint)
     {
-        std::unique_lock< std::mutex > lk{ mutex_ };
-        if (algos_.size() > 1)
-            (*algos_.begin())->notify();
+        if (__current_batch.owner != nullptr)
+            return false;
+
+        __current_batch.levels[level].reserve(hint);
+        __current_batch.owner = this;
+        return true;
     }
 
-    void shared_work_global_config::notify_all()
+    void shared_work_global_config::end_batch() noexcept
     {
-        std::unique_lock< std::mutex > lk{ mutex_ };
-        if (algos_.size() > 1)
+        BOOST_ASSERT(__current_batch.owner == this);
+        __current_batch.owner = nullptr;
+
+        auto& queue = rqueue(post_node());
+
+        std::size_t n = 0;
+        for (std::size_t level = priority_levels; level-- > 0;)
         {
-            for (auto& a : algos_)
-                a->notify();
+            auto& contexts = __current_batch.levels[level];
+            if (!contexts.empty())
+            {
+                queue.push_bulk(contexts.begin(), contexts.end(), level);
+                n += contexts.size();
+                contexts.clear();
+            }
         }
+
+        if (n > 0)
+            idle_.wake_n(n);
+    }
+
+    bool shared_work_global_config::batching() const noexcept
+    {
+        return __current_batch.owner == this;
+    }
+
+    bool shared_work_global_config::backlogged() noexcept
+    {
+        if (!empty())
+            return true;
+
+        return visit_victims([](std::vector<work_stealing_with_properties*> const& victims) {
+            return std::any_of(victims.begin(), victims.end(),
+                [](work_stealing_with_properties* victim) { return victim->stealable(); });
+        });
+    }
+
+    void shared_work_global_config::add_victim(work_stealing_with_properties* victim)
+    {
+        std::unique_lock< std::shared_mutex > lk{ victims_mtx_ };
+        victims_.push_back(victim);
+    }
+
+    void shared_work_global_config::remove_victim(work_stealing_with_properties* victim)
+    {
+        std::unique_lock< std::shared_mutex > lk{ victims_mtx_ };
+        auto it = std::find(victims_.begin(), victims_.end(), victim);
+        if (it != victims_.end())
+            victims_.erase(it);
     }
 
     //////////////////////////////////////////////////////////////////////////
 
-    shared_work_with_properties::shared_work_with_properties(bool suspend/* = true*/)
-        : suspend_{ suspend }
+    shared_work_with_properties::shared_work_with_properties(
+        shared_work_global_config& config, bool suspend/* = true*/)
+        : global_config_{ config }
+        , suspend_{ suspend }
+        , slot_{ config.idle().acquire() }
     {
-        global_config_.add_instance(this);
     }
 
     shared_work_with_properties::~shared_work_with_properties()
     {
-        if (!shared_work_global_config_single::is_destroyed())
-            global_config_.remove_instance(this);
+        global_config_.idle().release(slot_);
     }
 
     void shared_work_with_properties::awakened(
@@ -54,22 +129,22 @@ namespace fiber_pool {
         {
             if(props.binding())
             {
-                // 不能绑定到主线程
-                BOOST_ASSERT(!global_config_.is_main_thread());
-
-                pqueue_.push_back(*ctx);
+                pqueue_.push(ctx, props.level());
             }
             else
             {
                 ctx->detach();
-                std::unique_lock< std::mutex > lk{ rqueue_mtx_ }; 
+                props.detach_worker();
                 /*<
                         worker fiber, enqueue on shared queue
                     >*/
-                rqueue_.push_back(ctx);
 
+                // 在本线程上为其他池创建的纤程, 转交给其所属的池
+                shared_work_global_config* owner = props.owner();
+                if (nullptr == owner)
+                    owner = &global_config_;
 
-                global_config_.notify_all();
+                owner->post(ctx, props);
             }
         }
     }
@@ -101,42 +176,37 @@ namespace fiber_pool {
 
     boost::fibers::context* shared_work_with_properties::pick_next() noexcept
     {
+        // 顺带唤醒已到期的睡眠纤程, 决定退出的扩展线程不再接手池中的纤程
+        bool retiring = shared_work_global_config::retiring();
+        if (!retiring)
+            global_config_.poll();
+
         boost::fibers::context* ctx = nullptr;
         do
         {
-            if (global_config_.is_main_thread())
-            {
-                // 若是主线程被调度, 则通知其他工作线程来处理
-                global_config_.notify_all();
-            }
-            else
+            // 绑定线程的纤程与共享队列中的纤程按优先级竞争, 同级时绑定线程的纤程优先
+            int level = pqueue_.top_level();
+            if (!retiring && level < global_config_.top_level())
             {
-                if (!pqueue_.empty())
-                {
-                    ctx = &pqueue_.front();
-                    pqueue_.pop_front();
+                ctx = global_config_.pop();
+                if (nullptr != ctx)
+                { /*<
+                        pop an item from the ready queue
+                    >*/
+                    waiter::attach(ctx);
+                    /*<
+                        attach context to the current scheduler of this thread
+                    >*/
+
                     break;
                 }
-                else
-                {
-                    std::unique_lock< std::mutex > lk{ rqueue_mtx_ };
-                    if (!rqueue_.empty())
-                    { /*<
-                            pop an item from the ready queue
-                        >*/
-                        ctx = rqueue_.front();
-                        rqueue_.pop_front();
-                        lk.unlock();
-                        BOOST_ASSERT(nullptr != ctx);
-                        boost::fibers::context::active()->attach(ctx);
-                        /*<
-                            attach context to current scheduler via the active fiber
-                            of this thread
-                        >*/
-
-                        break;
-                    }
-                }
+            }
+
+            // 共享队列中更高优先级的纤程可能已被其他线程取走
+            if (level >= 0)
+            {
+                ctx = pqueue_.at(level).pop();
+                break;
             }
 
             if (!lqueue_.empty()) 
@@ -149,49 +219,50 @@ namespace fiber_pool {
         }
         while (0);
 
-        return ctx;
+        return fiber_properties::run(ctx);
     }
 
     bool shared_work_with_properties::has_ready_fibers() const noexcept
     {
-        if (global_config_.is_main_thread())
-            return !lqueue_.empty();
-        else
-        {
-            std::unique_lock< std::mutex > lock{ rqueue_mtx_ };
-            return !pqueue_.empty() || !rqueue_.empty() || !lqueue_.empty();
-        }
+        return !pqueue_.empty() || !global_config_.empty() || !lqueue_.empty();
     }
 
     void shared_work_with_properties::suspend_until(
         std::chrono::steady_clock::time_point const& time_point) noexcept
     {
         if (suspend_) {
-            if ((std::chrono::steady_clock::time_point::max)() == time_point) {
-                std::unique_lock< std::mutex > lk{ mtx_ };
-                cnd_.wait(lk, [this]() { return flag_; });
-                flag_ = false;
-            }
-            else {
-                std::unique_lock< std::mutex > lk{ mtx_ };
-                cnd_.wait_until(lk, time_point, [this]() { return flag_; });
-                flag_ = false;
-            }
+            idle_registry& idle = global_config_.idle();
+            timer_wheel& timers = global_config_.timers();
+            auto& config = global_config_;
+
+            // 只有担任计时线程时才按时间轮的最近到期时间挂起
+            auto deadline = time_point;
+            bool keeper = timers.keep(slot_, deadline);
+
+            // 有纤程等待I/O时, 由一个空闲线程在epoll_wait或者 io_uring_enter() 中挂起
+            reactor& io = global_config_.io();
+            io_ring& ring = global_config_.ring();
+            bool polling = io.acquire();
+            bool reaping = !polling && ring.acquire();
+
+            // 自旋或挂起期间出现无人负责的定时器或者I/O等待者时返回, 重新尝试担任计时或轮询线程
+            auto has_work = [&config]() { return !config.empty() || config.unattended(); };
+            if (!idle.spin(slot_, deadline, has_work))
+                idle.park(slot_, deadline, has_work, polling ? static_cast<idle_waiter*>(&io) : reaping ? &ring : nullptr);
+
+            if (polling)
+                io.release();
+            if (reaping)
+                ring.release();
+            if (keeper)
+                timers.resign();
         }
     }
 
     void shared_work_with_properties::notify() noexcept
     {
-        if (suspend_) {
-            std::unique_lock< std::mutex > lk{ mtx_ };
-            flag_ = true;
-            lk.unlock();
-            cnd_.notify_all();
-        }
+        if (suspend_)
+            global_config_.idle().notify(slot_);
     }
 
-    // 静态成员对象对象实例化
-    shared_work_with_properties::rqueue_type shared_work_with_properties::rqueue_{};
-    std::mutex shared_work_with_properties::rqueue_mtx_{};
-
 } // fiber_pool
\ No newline at end of file
@@ -7,45 +7,195 @@
 #ifndef shared_work_h__
 #define shared_work_h__
 
-#include <set>
+#include <algorithm>
 #include <deque>
 #include <mutex>
 #include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <shared_mutex>
 #include <condition_variable>
 
 #include <boost/config.hpp>
 #include <boost/atomic.hpp>
 #include <boost/thread.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/serialization/singleton.hpp>
 #include <boost/fiber/algo/algorithm.hpp>
 #include <boost/fiber/context.hpp>
 #include <boost/fiber/detail/config.hpp>
 #include <boost/fiber/scheduler.hpp>
 
+#include "fiber_pool.hpp"
+#include "mpmc_queue.hpp"
+#include "idle_registry.hpp"
+#include "timer_wheel.hpp"
+#include "reactor.hpp"
+#include "io_ring.hpp"
+#include "multi_level_queue.hpp"
+
 namespace fiber_pool {
 
+// 就绪队列的级别数, 与 priority_t 一一对应
+enum { priority_levels = critical_priority + 1 };
+
+class shared_work_global_config;
+class work_stealing_with_properties;
+
 class fiber_properties : public boost::fibers::fiber_properties
 {
     int priority_;
+    shared_work_global_config* owner_;
+    boost::atomic_bool const* cancellation_;   // 所属 task_group 的取消标记
+    boost::atomic_size_t* attached_{ nullptr }; // 所附着的扩展线程的纤程计数, 参见 attached_fibers()
     boost::atomic_bool binding_{ false };
     boost::atomic_bool finished_{ false };
     boost::atomic_bool interrupted_{ false };
+    boost::atomic_int  handles_{ 0 };
+    boost::atomic_bool interrupt_on_destruct_{ false };
 public:
     fiber_properties(boost::fibers::context* ctx) 
         : boost::fibers::fiber_properties(ctx)
-        , priority_(0)
+        , priority_(initial_priority())
+        , owner_(initial_owner())
+        , cancellation_(initial_cancellation())
     {
     }
 
+    /*!
+     *  在当前线程上新建的纤程的初始优先级与所属的池.
+     *  纤程在构造时即被唤醒并放入就绪队列, 故 pool::dispatch() 需在构造前通过它们指定.
+     */
+    static int& initial_priority() noexcept {
+        static thread_local int priority = normal_priority;
+        return priority;
+    }
+
+    static shared_work_global_config*& initial_owner() noexcept {
+        static thread_local shared_work_global_config* owner = nullptr;
+        return owner;
+    }
+
+    static boost::atomic_bool const*& initial_cancellation() noexcept {
+        static thread_local boost::atomic_bool const* cancellation = nullptr;
+        return cancellation;
+    }
+
     boost::fibers::context* context() {
         return ctx_;
     }
 
+    // 所属的池, 不是通过池创建的纤程为nullptr
+    shared_work_global_config* owner() const {
+        return owner_;
+    }
+
+    int priority() const {
+        return priority_;
+    }
+
+    void set_priority(int priority) {
+        if (priority != priority_) {
+            priority_ = priority;
+            notify();
+        }
+    }
+
+    // 所在就绪队列的级别
+    std::size_t level() const {
+        return level_of(priority_);
+    }
+
+    static std::size_t level_of(int priority) {
+        if (priority < low_priority)
+            return low_priority;
+        if (priority > critical_priority)
+            return critical_priority;
+        return static_cast<std::size_t>(priority);
+    }
+
     bool interrupted() const {
         return interrupted_.load();
     }
 
+    // 替换所属 task_group 的取消标记, 返回原来的标记, 用于在调用者中执行组内的子任务
+    boost::atomic_bool const* exchange_cancellation(boost::atomic_bool const* cancellation) noexcept {
+        return std::exchange(cancellation_, cancellation);
+    }
+
+    // 纤程自身被请求中断, 所属的池正在清理, 或者所属的 task_group 被取消.
+    // 均为relaxed读取, 供 this_fiber::interrupted() 频繁调用
+    inline bool interruption_requested() const noexcept;
+
+    /*!
+     *  当前线程上正在运行的纤程的属性, 由本库的调度算法在 pick_next() 中更新;
+     *  线程未安装本库的调度算法, 或者正在运行调度纤程时为nullptr.
+     *  @note  以 launch::dispatch 启动的纤程在首次挂起之前不经过 pick_next(), 期间仍为启动者的属性.
+     */
+    static fiber_properties*& running() noexcept {
+        static thread_local fiber_properties* props = nullptr;
+        return props;
+    }
+
+    /*!
+     *  当前工作线程运行过的纤程数(不含main context 与 dispatcher context), 非工作线程为nullptr.
+     *  只由所属线程写入, 池据此判断线程是否停滞或者空闲.
+     */
+    static boost::atomic_size_t*& executed() noexcept {
+        static thread_local boost::atomic_size_t* counter = nullptr;
+        return counter;
+    }
+
+    /*!
+     *  当前扩展线程上附着的纤程数, 其他线程为nullptr. 纤程被本线程取出运行时计入, 与调度器分离或者结束时离开,
+     *  包括挂起在boost的同步原语上的纤程, 它们只能在本线程上恢复, 故扩展线程只在其为0时才退出.
+     */
+    static boost::atomic_size_t*& attached_fibers() noexcept {
+        static thread_local boost::atomic_size_t* counter = nullptr;
+        return counter;
+    }
+
+    // 与所附着的扩展线程分离, 在 context::detach() 时调用
+    void detach_worker() noexcept {
+        if (attached_ != nullptr) {
+            attached_->fetch_sub(1, boost::memory_order_relaxed);
+            attached_ = nullptr;
+        }
+    }
+
+    // 记录即将运行的纤程, 由各调度算法的 pick_next() 在返回前调用
+    static boost::fibers::context* run(boost::fibers::context* ctx) noexcept {
+        if (boost::atomic_size_t* counter = attached_fibers())
+            track_attached(ctx, counter);
+
+        running() = ctx != nullptr ?
+            static_cast<fiber_properties*>(ctx->get_properties()) : nullptr;
+
+        boost::atomic_size_t* counter = executed();
+        if (counter != nullptr && ctx != nullptr && !ctx->is_context(boost::fibers::type::pinned_context))
+            counter->store(counter->load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+        return ctx;
+    }
+
+    // 结束的纤程先从调度器的工作队列中移除, 再在切换出去时调用 pick_next(), 此时仍为 context::active()
+    static void track_attached(boost::fibers::context* ctx, boost::atomic_size_t* counter) noexcept {
+        boost::fibers::context* previous = boost::fibers::context::active();
+        if (previous != nullptr && !previous->is_context(boost::fibers::type::pinned_context) &&
+            !previous->worker_is_linked()) {
+            if (auto props = static_cast<fiber_properties*>(previous->get_properties()))
+                props->detach_worker();
+        }
+
+        if (ctx != nullptr && !ctx->is_context(boost::fibers::type::pinned_context)) {
+            auto props = static_cast<fiber_properties*>(ctx->get_properties());
+            if (props != nullptr && props->attached_ != counter) {
+                props->detach_worker();
+                counter->fetch_add(1, boost::memory_order_relaxed);
+                props->attached_ = counter;
+            }
+        }
+    }
+
     void interrupt() {
         interrupted_.store(true);
     }
@@ -65,72 +215,288 @@ public:
     bool binding() const {
         return binding_.load();
     }
+
+    // 指向该纤程的 fiber 对象的计数, 最后一个析构时 release_handle() 返回true
+    void add_handle() {
+        handles_.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    bool release_handle() {
+        return handles_.fetch_sub(1, boost::memory_order_acq_rel) == 1;
+    }
+
+    bool interrupt_on_destruct() const {
+        return interrupt_on_destruct_.load();
+    }
+
+    void set_interrupt_on_destruct() {
+        interrupt_on_destruct_.store(true);
+    }
 };
 
+/*!
+ *  @brief 池内所有工作线程共享的状态
+ *
+ *  每个池拥有一个实例, 不同的池之间不共享任何队列与线程, 因此一个池中的繁重任务不会延误另一个池中的纤程.
+ */
 class shared_work_global_config : boost::noncopyable
 {
-    boost::thread::id main_thread_id_;
+#if defined(FIBERPOOL_ENABLE_LOCKFREE_QUEUE)
+    typedef multi_level_queue<mpmc_queue<boost::fibers::context*>, priority_levels> rqueue_type;
+#else
+    typedef multi_level_queue<locked_queue<boost::fibers::context*>, priority_levels> rqueue_type;
+#endif
+
+    fiber_pool::pool& pool_;
+
+    idle_registry idle_;    // 空闲线程登记表
+    timer_wheel   timers_{ idle_ };  // 本池纤程的定时器, 参见 this_fiber::sleep_until()
+    reactor       reactor_{ idle_ }; // 本池纤程的I/O等待, 参见 pool_options::reactor
+    io_ring       ring_{ idle_ };    // 本池纤程的异步I/O, 参见 pool_options::uring
+
+    alignas(64) boost::atomic_bool cleaning_{ false };  // 池正在清理, 只在关闭时写入一次
+
+    // 共享队列, 即 shared_work 的就绪队列, work_stealing 的注入队列.
+    // 每个NUMA节点一个, 未启用亲和性时只有一个
+    std::vector<std::unique_ptr<rqueue_type>> rqueues_;
+    boost::atomic_size_t                      next_node_{ 0 };  // 非工作线程投递时轮流选择节点
+
+    std::vector<work_stealing_with_properties*> victims_;   // 可被窃取的实例, 参见 add_victim()
+    std::shared_mutex                           victims_mtx_;
 
-    std::mutex mutex_;
-    std::set<class shared_work_with_properties* > algos_;
 public:
+    /*!
+     *  @param nodes 工作线程所分布的NUMA节点数, 每个节点拥有一个共享队列
+     */
+    shared_work_global_config(fiber_pool::pool& pool, std::size_t nodes = 1)
+        : pool_(pool)
+    {
+        for (std::size_t i = 0; i < std::max<std::size_t>(nodes, 1); ++i)
+            rqueues_.emplace_back(new rqueue_type);
+    }
 
     ~shared_work_global_config()
     {
     }
 
-    void set_main_thread(boost::thread::id id) {
-        main_thread_id_ = id;
+    /*!
+     *  当前工作线程所属的池, 非工作线程返回nullptr.
+     */
+    static shared_work_global_config*& current() noexcept {
+        static thread_local shared_work_global_config* config = nullptr;
+        return config;
+    }
+
+    /*!
+     *  当前工作线程所在的节点, 在安装调度算法之前设置, 非工作线程为0.
+     */
+    static std::size_t& current_node() noexcept {
+        static thread_local std::size_t node = 0;
+        return node;
+    }
+
+    // 本线程作为扩展线程已决定退出, 调度算法不再从池中接手纤程, 只运行附着于本线程的纤程
+    static bool& retiring() noexcept {
+        static thread_local bool retiring = false;
+        return retiring;
+    }
+
+    fiber_pool::pool& pool() {
+        return pool_;
+    }
+
+    idle_registry& idle() {
+        return idle_;
+    }
+
+    timer_wheel& timers() {
+        return timers_;
+    }
+
+    reactor& io() {
+        return reactor_;
+    }
+
+    io_ring& ring() {
+        return ring_;
+    }
+
+    bool cleaning() const noexcept {
+        return cleaning_.load(boost::memory_order_relaxed);
+    }
+
+    // 池转入清理阶段, 之后池中的纤程 interrupted() 均返回true
+    void set_cleaning() noexcept {
+        cleaning_.store(true);
+        reactor_.cancel_all();
+        ring_.cancel_all();
+    }
+
+    std::size_t nodes() const noexcept {
+        return rqueues_.size();
+    }
+
+    rqueue_type& rqueue(std::size_t node) {
+        return *rqueues_[node];
+    }
+
+    // 本池工作线程所在的节点, 其他线程为0
+    std::size_t home_node() const noexcept {
+        return current() == this ? current_node() : 0;
+    }
+
+    // 投递时使用的节点: 本池的工作线程使用所在的节点, 其他线程轮流选择
+    std::size_t post_node() noexcept
+    {
+        if (rqueues_.size() == 1)
+            return 0;
+        if (current() == this)
+            return current_node();
+        return next_node_.fetch_add(1, boost::memory_order_relaxed) % rqueues_.size();
+    }
+
+    // 所有节点的共享队列均为空
+    bool empty() const noexcept
+    {
+        for (auto& q : rqueues_)
+        {
+            if (!q->empty())
+                return false;
+        }
+        return true;
+    }
+
+    // 有等待计时或者I/O的纤程而没有线程负责唤醒, 空闲线程不应挂起
+    bool unattended() const noexcept
+    {
+        return timers_.unattended() || reactor_.unattended();
     }
 
-    bool is_main_thread() const 
+    // 所有节点中非空的最高级别, 均为空时返回-1
+    int top_level() const noexcept
     {
-        // 主线程id必须有效
-        BOOST_ASSERT(main_thread_id_ != boost::thread::id());
-        return boost::this_thread::get_id() == main_thread_id_;
+        int level = -1;
+        for (auto& q : rqueues_)
+            level = std::max(level, q->top_level());
+        return level;
     }
 
-    void add_instance(class shared_work_with_properties* algo) 
+    // 从指定级别取出一个纤程, 先取本节点的队列, 再取其他节点的
+    boost::fibers::context* pop(std::size_t level) noexcept
     {
-        std::unique_lock< std::mutex > lk{ mutex_ };
-        algos_.insert(algo);
+        const std::size_t count = rqueues_.size();
+        const std::size_t home = home_node();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (auto ctx = rqueues_[(home + i) % count]->at(level).pop())
+                return ctx;
+        }
+        return nullptr;
     }
 
-    void remove_instance(class shared_work_with_properties* algo)
+    // 按优先级从高到低取出一个纤程
+    boost::fibers::context* pop() noexcept
     {
-        std::unique_lock< std::mutex > lk{ mutex_ };
-        auto it = algos_.find(algo);
-        if (it != algos_.end())
-            algos_.erase(it);
+        for (std::size_t level = priority_levels; level-- > 0;)
+        {
+            if (auto ctx = pop(level))
+                return ctx;
+        }
+        return nullptr;
     }
 
-    void notify_one();
-    void notify_all();
+    /*!
+     *  @brief 将已分离的纤程放入共享队列, 并唤醒一个空闲的工作线程
+     *  @note  用于从其他池或者非工作线程向本池转交纤程.
+     *         当前线程正在向本池批量投递时, 纤程被暂存到 end_batch() 时再放入.
+     */
+    void post(boost::fibers::context* ctx, fiber_properties& props);
+
+    /*!
+     *  @brief 在当前线程上开始批量投递
+     *
+     *  @param level 批量投递的纤程所在的级别, 用于预留暂存空间
+     *  @param hint  预计投递的纤程数, 未知时为0
+     *  @return 当前线程已经在批量投递时返回false, 此时不应调用 end_batch().
+     */
+    bool begin_batch(std::size_t level, std::size_t hint);
+
+    /*!
+     *  将暂存的纤程逐级一次性放入共享队列, 并唤醒足够数量的空闲工作线程.
+     */
+    void end_batch() noexcept;
+
+    // 当前线程是否正在向本池批量投递
+    bool batching() const noexcept;
+
+    /*!
+     *  池中是否有排队等待执行的纤程, 包括共享队列以及 work_stealing 各线程的本地队列.
+     */
+    bool backlogged() noexcept;
+
+    // 登记与注销可被窃取的 work_stealing 实例, 注销之后不会再有窃取者访问其本地队列
+    void add_victim(work_stealing_with_properties* victim);
+    void remove_victim(work_stealing_with_properties* victim);
+
+    /*!
+     *  以可被窃取的实例的列表调用fn并返回其结果, 期间持有共享锁, 列表中的实例不会被注销.
+     */
+    template< typename Fn >
+    auto visit_victims(Fn&& fn)
+    {
+        std::shared_lock< std::shared_mutex > lk{ victims_mtx_ };
+        return fn(const_cast<std::vector<work_stealing_with_properties*> const&>(victims_));
+    }
+
+    /*!
+     *  @brief 唤醒本池已到期的睡眠纤程, I/O就绪以及I/O完成的纤程, 由各调度算法的 pick_next() 调用
+     *
+     *  同时唤醒的纤程作为一批放入共享队列, 并一次唤醒足够数量的空闲线程; 没有定时器与I/O等待时只是几次relaxed读取.
+     */
+    void poll() noexcept
+    {
+        if (waiter::suspending())
+            return;
+
+        waiter* fired = timers_.expire();
+        waiter* ready = reactor_.collect();
+        waiter* done = ring_.collect();
+        if (fired == nullptr && ready == nullptr && done == nullptr)
+            return;
+
+        bool batch = begin_batch(normal_priority, 0);
+        waiter::wake(fired);
+        waiter::wake(ready);
+        waiter::wake(done);
+        if (batch)
+            end_batch();
+    }
 };
 
-typedef boost::serialization::singleton<shared_work_global_config> shared_work_global_config_single;
+inline bool fiber_properties::interruption_requested() const noexcept
+{
+    return interrupted_.load(boost::memory_order_relaxed) ||
+        (owner_ != nullptr && owner_->cleaning()) ||
+        (cancellation_ != nullptr && cancellation_->load(boost::memory_order_relaxed));
+}
 
 class shared_work_with_properties :
     public boost::fibers::algo::algorithm_with_properties<fiber_properties>
 {
-    typedef std::deque<boost::fibers::context*> rqueue_type;
+    typedef multi_level_queue<ready_list, priority_levels> pqueue_type;
     typedef boost::fibers::scheduler::ready_queue_type lqueue_type;
 
-    static rqueue_type      rqueue_;    // 共享队列
-    static std::mutex       rqueue_mtx_;
+    // 所属池的全局配置
+    shared_work_global_config& global_config_;
 
-    lqueue_type             pqueue_{};  // 优先队列, 绑定线程的纤程
+    pqueue_type             pqueue_{};  // 优先队列, 绑定线程的纤程, 按优先级分级
     lqueue_type             lqueue_{};  // 本地队列, main context, dispatcher context
-    std::mutex              mtx_{};
-    std::condition_variable cnd_{};
-    bool                    flag_{ false };
     bool                    suspend_{ false };
 
-    // 全局配置
-    shared_work_global_config& global_config_{shared_work_global_config_single::get_mutable_instance()};
+    uint32_t                slot_;      // 在空闲线程登记表中的槽位
 
 public:
-    shared_work_with_properties(bool suspend = true);
+    shared_work_with_properties(shared_work_global_config& config, bool suspend = true);
     ~shared_work_with_properties();
 
     shared_work_with_properties(shared_work_with_properties const&) = delete;
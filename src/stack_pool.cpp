@@ -0,0 +1,162 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "stack_pool.hpp"
+
+#include <algorithm>
+
+#include <boost/context/stack_traits.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+
+namespace fiber_pool {
+
+    // 当前线程作为工作线程所属的栈池, 以及其本地缓存的索引
+    static thread_local stack_pool* __current_stack_pool{ nullptr };
+    static thread_local std::size_t __current_stack_index{ 0 };
+
+    stack_pool::stack_pool(stack_allocator_t type, std::size_t size, std::size_t limit, std::size_t workers)
+        : type_(type)
+        , size_(size)
+        , limit_(limit)
+    {
+        typedef boost::context::stack_traits traits_type;
+
+        if (size_ == 0)
+            size_ = traits_type::default_size();
+
+        size_ = (std::max)(size_, traits_type::minimum_size());
+        if (!traits_type::is_unbounded())
+            size_ = (std::min)(size_, traits_type::maximum_size());
+
+        // 预留缓存的容量, 使释放时不再需要分配内存
+        if (type_ == pooled_fixedsize_stack)
+        {
+            for (std::size_t i = 0; i < workers; ++i)
+            {
+                locals_.emplace_back(new cache);
+                locals_.back()->stacks.reserve(local_limit);
+            }
+
+            shared_.stacks.reserve(limit_);
+        }
+    }
+
+    stack_pool::~stack_pool()
+    {
+        for (auto& local : locals_)
+        {
+            for (auto& sctx : local->stacks)
+                deallocate_now(sctx);
+        }
+
+        for (auto& sctx : shared_.stacks)
+            deallocate_now(sctx);
+    }
+
+    void stack_pool::attach_worker(std::size_t index) noexcept
+    {
+        if (index < locals_.size())
+        {
+            __current_stack_pool = this;
+            __current_stack_index = index;
+        }
+    }
+
+    stack_pool::cache* stack_pool::local() noexcept
+    {
+        if (__current_stack_pool == this)
+            return locals_[__current_stack_index].get();
+
+        return nullptr;
+    }
+
+    boost::context::stack_context stack_pool::allocate_new()
+    {
+        if (type_ == protected_fixedsize_stack)
+            return boost::context::protected_fixedsize_stack(size_).allocate();
+
+        return boost::context::fixedsize_stack(size_).allocate();
+    }
+
+    void stack_pool::deallocate_now(boost::context::stack_context& sctx) noexcept
+    {
+        if (type_ == protected_fixedsize_stack)
+            boost::context::protected_fixedsize_stack(size_).deallocate(sctx);
+        else
+            boost::context::fixedsize_stack(size_).deallocate(sctx);
+    }
+
+    boost::context::stack_context stack_pool::allocate()
+    {
+        if (type_ != pooled_fixedsize_stack)
+            return allocate_new();
+
+        if (cache* c = local())
+        {
+            std::unique_lock< std::mutex > lk{ c->mtx };
+            if (!c->stacks.empty())
+            {
+                auto sctx = c->stacks.back();
+                c->stacks.pop_back();
+                return sctx;
+            }
+        }
+
+        {
+            std::unique_lock< std::mutex > lk{ shared_.mtx };
+            if (!shared_.stacks.empty())
+            {
+                auto sctx = shared_.stacks.back();
+                shared_.stacks.pop_back();
+                return sctx;
+            }
+        }
+
+        // 非工作线程不会释放栈, 从工作线程的本地缓存中取, 但不与其争抢
+        if (local() == nullptr)
+        {
+            for (auto& c : locals_)
+            {
+                std::unique_lock< std::mutex > lk{ c->mtx, std::try_to_lock };
+                if (lk.owns_lock() && !c->stacks.empty())
+                {
+                    auto sctx = c->stacks.back();
+                    c->stacks.pop_back();
+                    return sctx;
+                }
+            }
+        }
+
+        return allocate_new();
+    }
+
+    void stack_pool::deallocate(boost::context::stack_context& sctx) noexcept
+    {
+        if (type_ == pooled_fixedsize_stack)
+        {
+            if (cache* c = local())
+            {
+                std::unique_lock< std::mutex > lk{ c->mtx };
+                if (c->stacks.size() < local_limit)
+                {
+                    c->stacks.push_back(sctx);
+                    return;
+                }
+            }
+
+            std::unique_lock< std::mutex > lk{ shared_.mtx };
+            if (shared_.stacks.size() < limit_)
+            {
+                shared_.stacks.push_back(sctx);
+                return;
+            }
+        }
+
+        deallocate_now(sctx);
+    }
+
+} // fiber_pool
@@ -0,0 +1,97 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef stack_pool_h__
+#define stack_pool_h__
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+#include <boost/context/stack_context.hpp>
+
+#include "fiber_pool.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 纤程栈的分配器
+ *
+ *  按照 stack_allocator_t 选择分配方式. 对于 pooled_fixedsize_stack, 纤程结束后其栈被放回缓存以供复用,
+ *  复用的栈已被访问过, 其页面通常仍驻留在内存中, 因此既省去了分配的开销, 也不会再次触发缺页.
+ *
+ *  每个工作线程拥有一个本地缓存, 本地缓存已满或者在非工作线程中释放的栈放入共享缓存;
+ *  非工作线程(如主线程)分配时先取共享缓存, 再尝试从工作线程的本地缓存中取.
+ */
+class stack_pool : boost::noncopyable
+{
+    struct cache
+    {
+        std::mutex                                  mtx;
+        std::vector<boost::context::stack_context>  stacks;
+    };
+
+    enum { local_limit = 16 };  // 每个本地缓存最多缓存的栈数
+
+    stack_allocator_t                    type_;
+    std::size_t                          size_;
+    std::size_t                          limit_;    // 共享缓存最多缓存的栈数
+    std::vector<std::unique_ptr<cache>>  locals_;
+    cache                                shared_;
+
+    boost::context::stack_context allocate_new();
+    void deallocate_now(boost::context::stack_context& sctx) noexcept;
+
+    cache* local() noexcept;
+
+public:
+    /*!
+     *  @param type    栈的分配方式
+     *  @param size    栈的大小, 0则使用boost的默认值
+     *  @param limit   共享缓存最多缓存的栈数
+     *  @param workers 工作线程数
+     */
+    stack_pool(stack_allocator_t type, std::size_t size, std::size_t limit, std::size_t workers);
+    ~stack_pool();
+
+    /*!
+     *  在第index个工作线程中调用, 之后该线程释放的栈优先放入其本地缓存.
+     */
+    void attach_worker(std::size_t index) noexcept;
+
+    boost::context::stack_context allocate();
+    void deallocate(boost::context::stack_context& sctx) noexcept;
+};
+
+/*!
+ *  @brief 传递给 boost::fibers::fiber 的栈分配器, 共同持有 stack_pool
+ *  @note  分配器随纤程的上下文一起保存, 纤程的句柄可以在池析构之后才释放其上下文,
+ *         故每个纤程都持有 stack_pool 的一份所有权, 最后一个纤程释放栈之后 stack_pool 才析构.
+ */
+class pool_stack_allocator
+{
+    std::shared_ptr<stack_pool> pool_;
+
+public:
+    explicit pool_stack_allocator(std::shared_ptr<stack_pool> const& pool) noexcept
+        : pool_(pool)
+    {
+    }
+
+    boost::context::stack_context allocate() {
+        return pool_->allocate();
+    }
+
+    void deallocate(boost::context::stack_context& sctx) noexcept {
+        pool_->deallocate(sctx);
+    }
+};
+
+} // fiber_pool
+
+#endif // stack_pool_h__
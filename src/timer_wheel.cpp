@@ -0,0 +1,244 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "timer_wheel.hpp"
+
+#include <mutex>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+namespace fiber_pool {
+
+    // 从第start位开始循环查找第一个置位的位, 返回其相对start的偏移, 没有时返回-1
+    static int first_set_from(std::uint64_t bits, unsigned start) noexcept
+    {
+        if (bits == 0)
+            return -1;
+
+        if (start != 0)
+            bits = (bits >> start) | (bits << (64 - start));
+
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    timer_wheel::timer_wheel(idle_registry& idle)
+        : idle_(idle)
+        , origin_(clock_type::now())
+    {
+    }
+
+    timer_wheel::~timer_wheel()
+    {
+    }
+
+    std::uint64_t timer_wheel::now_tick() const noexcept
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - origin_);
+        return static_cast<std::uint64_t>((std::max)(elapsed.count(), decltype(elapsed.count())(0)));
+    }
+
+    timer_wheel::clock_type::time_point timer_wheel::time_of(std::uint64_t tick) const noexcept
+    {
+        return origin_ + std::chrono::milliseconds(tick);
+    }
+
+    void timer_wheel::link(node* n) noexcept
+    {
+        // 超出最高层范围的定时器暂时放在最高层的最远处, 下沉时重新计算位置
+        std::uint64_t delta = n->expiry - current_;
+        std::uint64_t place = n->expiry;
+        std::size_t level = 0;
+        while (level + 1 < levels && delta >= (std::uint64_t(1) << (level_bits * (level + 1))))
+            ++level;
+
+        if (delta >= (std::uint64_t(1) << (level_bits * levels)))
+            place = current_ + (std::uint64_t(1) << (level_bits * levels)) - 1;
+
+        std::size_t index = (place >> (level_bits * level)) & (slots - 1);
+        node*& head = slots_[level][index];
+        n->next = head;
+        head = n;
+        occupied_[level] |= std::uint64_t(1) << index;
+    }
+
+    // 将第level层当前刻度对应的槽位中的定时器下沉到较低的层
+    void timer_wheel::cascade(std::size_t level) noexcept
+    {
+        std::size_t index = (current_ >> (level_bits * level)) & (slots - 1);
+        node* n = slots_[level][index];
+        slots_[level][index] = nullptr;
+        occupied_[level] &= ~(std::uint64_t(1) << index);
+
+        while (n != nullptr)
+        {
+            node* next = static_cast<node*>(n->next);
+            link(n);
+            n = next;
+        }
+    }
+
+    // 第0层的槽位到期的刻度与较高层的槽位下沉的刻度中最早的一个
+    std::uint64_t timer_wheel::next_due() const noexcept
+    {
+        if (size_ == 0)
+            return never;
+
+        std::uint64_t due = never;
+        for (std::size_t level = 0; level < levels; ++level)
+        {
+            const unsigned shift = level_bits * static_cast<unsigned>(level);
+            const std::uint64_t span = std::uint64_t(1) << shift;
+
+            // 本层下一次处理的刻度, 第0层为每个刻度, 较高层为对齐到本层粒度的刻度
+            std::uint64_t first = (current_ + span - 1) & ~(span - 1);
+            int offset = first_set_from(occupied_[level], (first >> shift) & (slots - 1));
+            if (offset >= 0)
+                due = (std::min)(due, first + (std::uint64_t(offset) << shift));
+        }
+
+        return due;
+    }
+
+    // 处理直到now(含)的所有刻度, 返回到期的定时器链表
+    waiter* timer_wheel::advance(std::uint64_t now) noexcept
+    {
+        waiter* fired = nullptr;
+        while (current_ <= now)
+        {
+            for (std::size_t level = 1; level < levels; ++level)
+            {
+                if ((current_ & ((std::uint64_t(1) << (level_bits * level)) - 1)) != 0)
+                    break;
+                cascade(level);
+            }
+
+            // 跳过中间没有定时器的刻度
+            std::uint64_t due = next_due();
+            if (due > now)
+            {
+                current_ = now + 1;
+                break;
+            }
+
+            if (due > current_)
+            {
+                current_ = due;
+                continue;
+            }
+
+            // 第0层的槽位中均为恰好在当前刻度到期的定时器
+            std::size_t index = current_ & (slots - 1);
+            node* n = slots_[0][index];
+            slots_[0][index] = nullptr;
+            occupied_[0] &= ~(std::uint64_t(1) << index);
+
+            while (n != nullptr)
+            {
+                node* next = static_cast<node*>(n->next);
+                n->next = fired;
+                fired = n;
+                --size_;
+                n = next;
+            }
+
+            ++current_;
+        }
+
+        return fired;
+    }
+
+    void timer_wheel::sleep_until(clock_type::time_point const& time_point) noexcept
+    {
+        if (time_point <= clock_type::now())
+            return;
+
+        // 向上取整, 使唤醒不早于time_point
+        auto delta = time_point - origin_;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(delta);
+        if (ms < delta)
+            ++ms;
+
+        node n;
+        n.expiry = static_cast<std::uint64_t>(ms.count());
+
+        boost::fibers::detail::spinlock_lock lk{ n.mtx };
+        {
+            std::unique_lock<boost::fibers::detail::spinlock> wlk{ mtx_ };
+            if (n.expiry < current_)
+                return;
+
+            link(&n);
+            ++size_;
+
+            std::uint64_t due = next_due();
+            due_.store(due);
+
+            // 新的定时器早于计时线程的截止时间时唤醒它重新计算.
+            // 没有计时线程时唤醒一个空闲线程来担任, 本线程可能一直忙于其他纤程而不会挂起
+            std::uint32_t keeper = keeper_.load();
+            if (keeper == 0)
+                idle_.wake_one();
+            else if (due < keeper_due_.load())
+                idle_.notify(keeper - 1);
+        }
+
+        n.suspend(lk);
+    }
+
+    waiter* timer_wheel::expire() noexcept
+    {
+        std::uint64_t due = due_.load(std::memory_order_relaxed);
+        if (due == never || due > now_tick())
+            return nullptr;
+
+        // 其他线程正在推进时直接返回
+        std::unique_lock<boost::fibers::detail::spinlock> lk{ mtx_, std::try_to_lock };
+        if (!lk.owns_lock())
+            return nullptr;
+
+        waiter* fired = advance(now_tick());
+        due_.store(next_due());
+        return fired;
+    }
+
+    bool timer_wheel::keep(std::uint32_t slot, clock_type::time_point& time_point) noexcept
+    {
+        if (due_.load() == never)
+            return false;
+
+        std::uint32_t expected = 0;
+        if (!keeper_.compare_exchange_strong(expected, slot + 1))
+            return false;
+
+        // 登记之后再读取, 之后插入的更早的定时器会通知本线程
+        std::uint64_t due = due_.load();
+        keeper_due_.store(due);
+        if (due != never)
+            time_point = (std::min)(time_point, time_of(due));
+        return true;
+    }
+
+    void timer_wheel::resign() noexcept
+    {
+        keeper_due_.store(never);
+        keeper_.store(0);
+    }
+
+    bool timer_wheel::unattended() const noexcept
+    {
+        return due_.load() != never && keeper_.load() == 0;
+    }
+
+} // fiber_pool
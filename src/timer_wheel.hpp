@@ -0,0 +1,104 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef timer_wheel_h__
+#define timer_wheel_h__
+
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+#include <boost/fiber/detail/spinlock.hpp>
+
+#include "waiter.hpp"
+#include "idle_registry.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 池内所有工作线程共享的分层时间轮
+ *
+ *  共4层, 每层64个槽位, 精度为1ms, 第0层覆盖64ms, 第3层覆盖约4.6小时, 更远的定时器先放入最高层, 下沉时重新计算位置.
+ *  定时器节点位于睡眠纤程的栈上, 以侵入式链表挂在槽位中, 插入为O(1), 不分配内存.
+ *
+ *  同一时刻只有一个空闲的工作线程(计时线程)按时间轮的最近到期时间挂起, 其余线程不受定时器影响;
+ *  到期的定时器在一次推进中被批量取出并唤醒, 故大量同时到期的定时器只需唤醒一次.
+ *  忙碌的工作线程在 pick_next() 中顺带推进时间轮, 在没有定时器时只是一次relaxed读取.
+ */
+class timer_wheel : boost::noncopyable
+{
+public:
+    struct node : waiter
+    {
+        std::uint64_t            expiry{ 0 };       // 到期的刻度
+    };
+
+private:
+    enum { level_bits = 6, slots = 1 << level_bits, levels = 4 };
+
+    static constexpr std::uint64_t never = UINT64_MAX;
+
+    typedef std::chrono::steady_clock clock_type;
+
+    idle_registry&                 idle_;
+    clock_type::time_point         origin_;         // 第0个刻度
+
+    boost::fibers::detail::spinlock mtx_;
+    node*                          slots_[levels][slots]{};
+    std::uint64_t                  occupied_[levels]{}; // 各层非空槽位的位图
+    std::uint64_t                  current_{ 0 };       // 下一个待处理的刻度
+    std::size_t                    size_{ 0 };
+
+    alignas(64) std::atomic<std::uint64_t> due_{ never };       // 下一次需要推进的刻度, 修改时需持有mtx_
+    alignas(64) std::atomic<std::uint32_t> keeper_{ 0 };        // 计时线程的槽位+1, 0表示没有计时线程
+    std::atomic<std::uint64_t>             keeper_due_{ never }; // 计时线程挂起的截止刻度
+
+    void link(node* n) noexcept;
+    void cascade(std::size_t level) noexcept;
+    std::uint64_t next_due() const noexcept;
+    waiter* advance(std::uint64_t now) noexcept;
+
+    std::uint64_t now_tick() const noexcept;
+    clock_type::time_point time_of(std::uint64_t tick) const noexcept;
+
+public:
+    explicit timer_wheel(idle_registry& idle);
+    ~timer_wheel();
+
+    /*!
+     *  @brief 挂起当前纤程直到time_point
+     *
+     *  唤醒的时刻向上取整到1ms, 故不会早于time_point.
+     *  @note  必须在安装了本库调度算法的工作线程中的纤程内调用.
+     */
+    void sleep_until(clock_type::time_point const& time_point) noexcept;
+
+    /*!
+     *  @brief 推进时间轮, 取出所有已到期的定时器
+     *
+     *  没有到期的定时器, 或者其他线程正在推进时返回nullptr. 须在工作线程中调用, 参见 shared_work_global_config::poll().
+     */
+    waiter* expire() noexcept;
+
+    /*!
+     *  @brief 尝试成为计时线程
+     *
+     *  若有未到期的定时器且当前没有计时线程, 则登记slot为计时线程, 并将time_point提前到最近到期时间.
+     *  成功时返回true, 调用者挂起结束后需调用 resign().
+     */
+    bool keep(std::uint32_t slot, clock_type::time_point& time_point) noexcept;
+    void resign() noexcept;
+
+    /*!
+     *  有未到期的定时器但没有计时线程, 空闲线程挂起前应重新尝试 keep().
+     */
+    bool unattended() const noexcept;
+};
+
+} // fiber_pool
+
+#endif // timer_wheel_h__
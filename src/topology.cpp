@@ -0,0 +1,238 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "topology.hpp"
+
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/predef/os.h>
+#include <boost/thread/thread.hpp>
+
+#if BOOST_OS_WINDOWS
+#   include <windows.h>
+#elif BOOST_OS_LINUX
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+namespace fiber_pool {
+
+#if BOOST_OS_LINUX
+
+    // 解析形如 "0-3,8-11" 的CPU列表
+    static std::vector<unsigned> parse_cpulist(std::string const& text)
+    {
+        std::vector<unsigned> cpus;
+        std::size_t pos = 0;
+        while (pos < text.size())
+        {
+            std::size_t end = text.find(',', pos);
+            if (end == std::string::npos)
+                end = text.size();
+
+            std::string item = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            if (item.empty() || item[0] < '0' || item[0] > '9')
+                continue;
+
+            try
+            {
+                std::size_t dash = item.find('-');
+                unsigned first = static_cast<unsigned>(std::stoul(item.substr(0, dash)));
+                unsigned last = dash == std::string::npos ? first :
+                    static_cast<unsigned>(std::stoul(item.substr(dash + 1)));
+
+                for (unsigned cpu = first; cpu <= last; ++cpu)
+                    cpus.push_back(cpu);
+            }
+            catch (...)
+            {
+            }
+        }
+
+        return cpus;
+    }
+
+    static bool allowed_cpu(cpu_set_t const& allowed, unsigned cpu) noexcept
+    {
+        return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed);
+    }
+
+    topology topology::current()
+    {
+        topology topo;
+
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            for (unsigned cpu = 0; cpu < boost::thread::hardware_concurrency() && cpu < CPU_SETSIZE; ++cpu)
+                CPU_SET(cpu, &allowed);
+        }
+
+        // 节点编号可能不连续, 逐个探测直到连续若干个节点不存在
+        for (unsigned node = 0, missing = 0; missing < 64; ++node)
+        {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file)
+            {
+                ++missing;
+                continue;
+            }
+            missing = 0;
+
+            std::string text;
+            std::getline(file, text);
+
+            std::vector<unsigned> cpus = parse_cpulist(text);
+            cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                [&allowed](unsigned cpu) { return !allowed_cpu(allowed, cpu); }), cpus.end());
+
+            if (!cpus.empty())
+                topo.nodes_.push_back(std::move(cpus));
+        }
+
+        if (topo.nodes_.empty())
+        {
+            std::vector<unsigned> cpus;
+            for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            }
+            topo.nodes_.push_back(std::move(cpus));
+        }
+
+        return topo;
+    }
+
+    bool bind_current_thread(std::vector<unsigned> const& cpus) noexcept
+    {
+        if (cpus.empty())
+            return true;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+#elif BOOST_OS_WINDOWS
+
+    // 只处理第0个处理器组, 即最多64个逻辑CPU
+    topology topology::current()
+    {
+        topology topo;
+
+        DWORD_PTR process_mask = 0, system_mask = 0;
+        if (!::GetProcessAffinityMask(::GetCurrentProcess(), &process_mask, &system_mask))
+            process_mask = ~DWORD_PTR(0);
+
+        ULONG highest = 0;
+        if (!::GetNumaHighestNodeNumber(&highest))
+            highest = 0;
+
+        for (ULONG node = 0; node <= highest; ++node)
+        {
+            ULONGLONG mask = 0;
+            if (!::GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+                continue;
+
+            std::vector<unsigned> cpus;
+            for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+            {
+                if ((mask & process_mask) & (ULONGLONG(1) << cpu))
+                    cpus.push_back(cpu);
+            }
+
+            if (!cpus.empty())
+                topo.nodes_.push_back(std::move(cpus));
+        }
+
+        if (topo.nodes_.empty())
+        {
+            std::vector<unsigned> cpus;
+            for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+            {
+                if (process_mask & (DWORD_PTR(1) << cpu))
+                    cpus.push_back(cpu);
+            }
+            topo.nodes_.push_back(std::move(cpus));
+        }
+
+        return topo;
+    }
+
+    bool bind_current_thread(std::vector<unsigned> const& cpus) noexcept
+    {
+        if (cpus.empty())
+            return true;
+
+        DWORD_PTR mask = 0;
+        for (unsigned cpu : cpus)
+        {
+            if (cpu < sizeof(DWORD_PTR) * 8)
+                mask |= DWORD_PTR(1) << cpu;
+        }
+
+        return mask != 0 && ::SetThreadAffinityMask(::GetCurrentThread(), mask) != 0;
+    }
+
+#else
+
+    // 其他平台不支持亲和性, 视为单个节点
+    topology topology::current()
+    {
+        topology topo;
+
+        std::vector<unsigned> cpus;
+        for (unsigned cpu = 0; cpu < std::max(boost::thread::hardware_concurrency(), 1u); ++cpu)
+            cpus.push_back(cpu);
+        topo.nodes_.push_back(std::move(cpus));
+
+        return topo;
+    }
+
+    bool bind_current_thread(std::vector<unsigned> const& cpus) noexcept
+    {
+        return cpus.empty();
+    }
+
+#endif
+
+    std::vector<placement> place_workers(topology const& topo, affinity_t affinity, std::size_t workers)
+    {
+        std::vector<placement> places(workers);
+        if (affinity == no_affinity || topo.nodes() == 0)
+            return places;
+
+        const std::size_t nodes = std::min(topo.nodes(), std::max<std::size_t>(workers, 1));
+        for (std::size_t i = 0; i < workers; ++i)
+        {
+            // 连续均分: 第i个线程位于第 i*nodes/workers 个节点
+            const std::size_t node = i * nodes / workers;
+            const std::size_t first = (node * workers + nodes - 1) / nodes;  // 该节点的第一个线程
+            auto const& cpus = topo.cpus(node);
+
+            places[i].node = node;
+            if (affinity == core_affinity)
+                places[i].cpus.push_back(cpus[(i - first) % cpus.size()]);
+            else
+                places[i].cpus = cpus;
+        }
+
+        return places;
+    }
+
+} // fiber_pool
@@ -0,0 +1,68 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef topology_h__
+#define topology_h__
+
+#include <vector>
+#include <cstddef>
+
+#include "fiber_pool.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 处理器拓扑, 即各NUMA节点所拥有的逻辑CPU
+ *
+ *  只包含当前进程允许使用的CPU, 没有CPU可用的节点被忽略.
+ *  无法获取NUMA信息时, 所有允许使用的CPU视为同一个节点.
+ */
+class topology
+{
+    std::vector<std::vector<unsigned>> nodes_;  // 各节点的逻辑CPU编号, 升序
+
+public:
+    /*!
+     *  读取当前系统的处理器拓扑.
+     */
+    static topology current();
+
+    std::size_t nodes() const noexcept {
+        return nodes_.size();
+    }
+
+    std::vector<unsigned> const& cpus(std::size_t node) const {
+        return nodes_[node];
+    }
+};
+
+/*!
+ *  @brief 工作线程的放置
+ */
+struct placement
+{
+    std::size_t             node{ 0 };  // 所属的节点
+    std::vector<unsigned>   cpus;       // 允许运行的CPU, 为空则不限制
+};
+
+/*!
+ *  @brief 计算各工作线程的放置
+ *
+ *  工作线程按编号连续地均分到各节点, 相邻编号的线程位于同一节点;
+ *  core_affinity 时节点内的线程依次绑定到节点内的各CPU, 线程多于CPU时循环绑定.
+ *  no_affinity 时所有线程位于节点0且不限制CPU.
+ */
+std::vector<placement> place_workers(topology const& topo, affinity_t affinity, std::size_t workers);
+
+/*!
+ *  @brief 将当前线程限定在给定的CPU上运行
+ *  @return 失败(如CPU不可用)时返回false, 线程保持原有的亲和性.
+ */
+bool bind_current_thread(std::vector<unsigned> const& cpus) noexcept;
+
+} // fiber_pool
+
+#endif // topology_h__
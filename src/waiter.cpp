@@ -0,0 +1,80 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "waiter.hpp"
+#include "shared_work.hpp"
+
+namespace fiber_pool {
+
+    // 正在 suspend() 中分离并挂起纤程的线程的调度器
+    static thread_local boost::fibers::scheduler* __detaching_scheduler = nullptr;
+
+    // 本线程正在 suspend() 中挂起纤程, 由随后的 pick_next() 清除
+    static thread_local bool __suspending = false;
+
+    void waiter::suspend(boost::fibers::detail::spinlock_lock& lk) noexcept
+    {
+        // 绑定线程的纤程被唤醒后仍需回到本线程
+        auto props = static_cast<fiber_properties*>(ctx->get_properties());
+        detached = props != nullptr && !props->binding() &&
+            !ctx->is_context(boost::fibers::type::pinned_context);
+
+        __suspending = true;
+
+        if (detached)
+        {
+            boost::fibers::scheduler* scheduler = ctx->get_scheduler();
+            __detaching_scheduler = scheduler;
+            ctx->detach();
+            props->detach_worker();
+            scheduler->suspend(lk);
+        }
+        else
+        {
+            ctx->suspend(lk);
+        }
+    }
+
+    bool waiter::suspending() noexcept
+    {
+        if (!__suspending)
+            return false;
+
+        __suspending = false;
+        return true;
+    }
+
+    void waiter::wake(waiter* list) noexcept
+    {
+        // 等待者位于被唤醒的纤程的栈上, 唤醒之前先取出后继
+        boost::fibers::context* active = boost::fibers::context::active();
+        while (list != nullptr)
+        {
+            // 等待纤程切换完成, detached在挂起时才设置, 须在此之后读取
+            list->mtx.lock();
+            list->mtx.unlock();
+
+            waiter* next = list->next;
+            boost::fibers::context* ctx = list->ctx;
+            bool detached = list->detached;
+
+            if (detached)
+                active->attach(ctx);
+            active->schedule(ctx);
+            list = next;
+        }
+    }
+
+    void waiter::attach(boost::fibers::context* ctx) noexcept
+    {
+        boost::fibers::context* active = boost::fibers::context::active();
+        if (active->get_scheduler() != nullptr)
+            active->attach(ctx);
+        else
+            __detaching_scheduler->attach_worker_context(ctx);
+    }
+
+} // fiber_pool
@@ -0,0 +1,68 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef waiter_h__
+#define waiter_h__
+
+#include <boost/fiber/context.hpp>
+#include <boost/fiber/scheduler.hpp>
+#include <boost/fiber/detail/spinlock.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 挂起在池内部的等待结构(时间轮, I/O反应器)上的纤程
+ *
+ *  位于挂起的纤程的栈上, 以侵入式链表挂在等待结构中. 纤程持有mtx直到切换完成, 唤醒者先获取mtx,
+ *  故不会在纤程挂起之前唤醒它, 而等待结构自身的锁只需在登记期间持有.
+ *
+ *  未绑定线程的纤程在挂起期间与调度器分离, 由唤醒者所在的工作线程直接接手. 原调度器只在其调度纤程中
+ *  处理其他线程的唤醒, 忙碌时会延误被唤醒的纤程.
+ */
+struct waiter
+{
+    waiter*                         next{ nullptr };
+    boost::fibers::context*         ctx;
+    bool                            detached{ false };  // 挂起期间已与调度器分离
+    boost::fibers::detail::spinlock mtx;
+
+    waiter() noexcept
+        : ctx(boost::fibers::context::active())
+    {
+    }
+
+    /*!
+     *  @brief 挂起当前纤程, 切换完成后才释放lk
+     *  @param lk 须持有mtx, 且当前纤程须已登记到等待结构中.
+     *  @note  须在安装了本库调度算法的工作线程中调用.
+     */
+    void suspend(boost::fibers::detail::spinlock_lock& lk) noexcept;
+
+    /*!
+     *  @brief 本线程刚在 suspend() 中挂起了纤程
+     *
+     *  调度器随即在本线程上调用 pick_next(), 此时不能唤醒任何等待者, 因为本纤程仍持有自己的mtx.
+     *  由 pick_next() 在唤醒等待者之前调用, 第一次调用返回true并清除标记.
+     */
+    static bool suspending() noexcept;
+
+    /*!
+     *  @brief 唤醒链表中的所有等待者, 已分离的纤程附着到当前线程
+     *  @note  须在工作线程的 pick_next() 中调用.
+     */
+    static void wake(waiter* list) noexcept;
+
+    /*!
+     *  @brief 将ctx附着到当前线程的调度器, 供调度算法在 pick_next() 中接手其他线程的纤程
+     *  @note  纤程在 suspend() 中与调度器分离之后才挂起, 期间调度器调用 pick_next() 时
+     *         context::active() 已不属于任何调度器, 故不能直接使用 context::active()->attach().
+     */
+    static void attach(boost::fibers::context* ctx) noexcept;
+};
+
+} // fiber_pool
+
+#endif // waiter_h__
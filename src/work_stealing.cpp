@@ -0,0 +1,244 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#include "work_stealing.hpp"
+
+namespace fiber_pool {
+
+    work_stealing_with_properties::work_stealing_with_properties(
+        shared_work_global_config& config, bool suspend/* = true*/)
+        : global_config_{ config }
+        , suspend_{ suspend }
+        , random_{ static_cast<std::minstd_rand::result_type>(
+            reinterpret_cast<std::uintptr_t>(this)) }
+        , slot_{ config.idle().acquire() }
+        , node_{ config.home_node() }
+    {
+        global_config_.add_victim(this);
+    }
+
+    work_stealing_with_properties::~work_stealing_with_properties()
+    {
+        // 先注销, 之后不会再有窃取者访问本地队列
+        global_config_.remove_victim(this);
+
+        // 本地队列中遗留的纤程转交给本节点的注入队列, 由其他线程继续执行
+        auto& injection = global_config_.rqueue(node_);
+        std::size_t transferred = 0;
+        for (std::size_t level = 0; level < rqueue_type::levels; ++level)
+        {
+            while (auto ctx = rqueue_.at(level).pop())
+            {
+                injection.push(ctx, level);
+                ++transferred;
+            }
+        }
+
+        global_config_.idle().release(slot_);
+
+        if (transferred > 0)
+            global_config_.idle().wake_n(transferred);
+    }
+
+    boost::fibers::context* work_stealing_with_properties::steal() noexcept
+    {
+        return global_config_.visit_victims([this](
+            std::vector<work_stealing_with_properties*> const& victims) -> boost::fibers::context*
+        {
+            const std::size_t count = victims.size();
+            if (count < 2)
+                return nullptr;
+
+            // 从随机位置开始遍历, 避免所有窃取者集中于同一个受害者.
+            // 每个级别先窃取本节点的线程, 再跨节点窃取
+            const std::size_t start = random_() % count;
+            const bool numa = global_config_.nodes() > 1;
+            for (std::size_t level = rqueue_type::levels; level-- > 0;)
+            {
+                for (int pass = 0; pass < (numa ? 2 : 1); ++pass)
+                {
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        work_stealing_with_properties* victim = victims[(start + i) % count];
+                        if (victim == this || (numa && (victim->node_ == node_) != (pass == 0)))
+                            continue;
+
+                        if (auto ctx = victim->rqueue_.at(level).steal())
+                            return ctx;
+                    }
+                }
+            }
+
+            return nullptr;
+        });
+    }
+
+    bool work_stealing_with_properties::has_stealable() const noexcept
+    {
+        return global_config_.backlogged();
+    }
+
+    void work_stealing_with_properties::awakened(
+        boost::fibers::context* ctx, fiber_properties& props) noexcept
+    {
+        if (ctx->is_context(boost::fibers::type::pinned_context))
+        {
+            // main context 以及 dispatcher context 永远不能被其他线程窃取
+            lqueue_.push_back(*ctx);
+        }
+        else
+        {
+            if (props.binding())
+            {
+                pqueue_.push(ctx, props.level());
+            }
+            else
+            {
+                ctx->detach();
+                props.detach_worker();
+
+                shared_work_global_config* owner = props.owner();
+                if (nullptr == owner)
+                    owner = &global_config_;
+
+                // 批量投递的纤程由 end_batch() 一次性放入注入队列
+                if (owner == &global_config_ && !global_config_.batching())
+                {
+                    rqueue_.push(ctx, props.level());
+
+                    // 唤醒一个空闲的工作线程来窃取, 若已有线程在自旋查找任务则无需唤醒
+                    global_config_.idle().wake_one();
+                }
+                else
+                {
+                    // 在本线程上为其他池创建的纤程, 转交给其所属的池
+                    owner->post(ctx, props);
+                }
+            }
+        }
+    }
+
+    void work_stealing_with_properties::property_change(
+        boost::fibers::context* ctx, fiber_properties& props) noexcept
+    {
+        // 只有位于 pqueue_ / lqueue_ 中的纤程是链接状态,
+        // 本地队列与注入队列中的纤程会在下次被唤醒时按新的属性处理.
+        if (!ctx->ready_is_linked())
+            return;
+
+        ctx->ready_unlink();
+        awakened(ctx, props);
+    }
+
+    boost::fibers::context* work_stealing_with_properties::pick_next() noexcept
+    {
+        // 顺带唤醒已到期的睡眠纤程, 决定退出的扩展线程不再接手池中的纤程
+        bool retiring = shared_work_global_config::retiring();
+        if (!retiring)
+            global_config_.poll();
+
+        // 定期先取注入队列, 避免本地队列中反复让出的纤程使其饥饿
+        bool fair = ++ticks_ % fairness_interval == 0;
+
+        boost::fibers::context* ctx = nullptr;
+        do
+        {
+            // 按优先级从高到低依次尝试: 绑定线程的纤程, 本地队列(LIFO), 注入队列
+            for (std::size_t level = rqueue_type::levels; level-- > 0;)
+            {
+                ctx = pqueue_.at(level).pop();
+                if (nullptr != ctx)
+                    break;
+
+                if (retiring)
+                {
+                    ctx = rqueue_.at(level).pop();
+                }
+                else if (fair)
+                {
+                    ctx = global_config_.pop(level);
+                    if (nullptr == ctx)
+                        ctx = rqueue_.at(level).pop();
+                }
+                else
+                {
+                    ctx = rqueue_.at(level).pop();
+                    if (nullptr == ctx)
+                        ctx = global_config_.pop(level);
+                }
+
+                if (nullptr != ctx)
+                {
+                    waiter::attach(ctx);
+                    break;
+                }
+            }
+
+            if (nullptr != ctx)
+                break;
+
+            // 最后窃取其他线程(FIFO)
+            ctx = retiring ? nullptr : steal();
+            if (nullptr != ctx)
+            {
+                waiter::attach(ctx);
+                break;
+            }
+
+            if (!lqueue_.empty())
+            {
+                ctx = &lqueue_.front();
+                lqueue_.pop_front();
+            }
+        }
+        while (0);
+
+        return fiber_properties::run(ctx);
+    }
+
+    bool work_stealing_with_properties::has_ready_fibers() const noexcept
+    {
+        return !pqueue_.empty() || !rqueue_.empty() || !lqueue_.empty() || !global_config_.empty();
+    }
+
+    void work_stealing_with_properties::suspend_until(
+        std::chrono::steady_clock::time_point const& time_point) noexcept
+    {
+        if (suspend_) {
+            idle_registry& idle = global_config_.idle();
+            timer_wheel& timers = global_config_.timers();
+
+            // 只有担任计时线程时才按时间轮的最近到期时间挂起
+            auto deadline = time_point;
+            bool keeper = timers.keep(slot_, deadline);
+
+            // 有纤程等待I/O时, 由一个空闲线程在epoll_wait或者 io_uring_enter() 中挂起
+            reactor& io = global_config_.io();
+            io_ring& ring = global_config_.ring();
+            bool polling = io.acquire();
+            bool reaping = !polling && ring.acquire();
+
+            // 自旋或挂起期间出现无人负责的定时器或者I/O等待者时返回, 重新尝试担任计时或轮询线程
+            auto has_work = [this]() { return has_stealable() || global_config_.unattended(); };
+            if (!idle.spin(slot_, deadline, has_work))
+                idle.park(slot_, deadline, has_work, polling ? static_cast<idle_waiter*>(&io) : reaping ? &ring : nullptr);
+
+            if (polling)
+                io.release();
+            if (reaping)
+                ring.release();
+            if (keeper)
+                timers.resign();
+        }
+    }
+
+    void work_stealing_with_properties::notify() noexcept
+    {
+        if (suspend_)
+            global_config_.idle().notify(slot_);
+    }
+
+} // fiber_pool
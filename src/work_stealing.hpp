@@ -0,0 +1,90 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef work_stealing_h__
+#define work_stealing_h__
+
+#include <atomic>
+#include <random>
+#include <cstdint>
+#include <chrono>
+
+#include "shared_work.hpp"
+#include "mpmc_queue.hpp"
+#include "work_stealing_queue.hpp"
+
+namespace fiber_pool {
+
+/*!
+ *  @brief 工作窃取调度算法
+ *
+ *  每个工作线程拥有一个本地的Chase-Lev队列, 本线程唤醒的纤程压入本地队列并以LIFO的方式取出;
+ *  本地队列为空时, 再依次尝试注入队列以及随机选择其他线程的本地队列以FIFO的方式窃取.
+ *  这使得投递与恢复纤程不再竞争同一个互斥量, 吞吐量可以随核心数扩展.
+ *
+ *  @note  非工作线程以及其他池转交的纤程, 线程退出时本地队列中遗留的纤程, 将放入共享的注入队列中.
+ *         各队列均按优先级分级, 本线程总是先执行可见的最高优先级的纤程, 只有本地与注入队列
+ *         均为空时才去窃取, 窃取时同样从最高的级别开始. 每 fairness_interval 次调度先取注入队列一次.
+ *         工作线程分布在多个NUMA节点上时, 先取本节点的注入队列, 先窃取本节点的线程, 最后才跨节点.
+ */
+class work_stealing_with_properties :
+    public boost::fibers::algo::algorithm_with_properties<fiber_properties>
+{
+    typedef multi_level_queue<work_stealing_queue<boost::fibers::context*>, priority_levels> rqueue_type;
+    typedef multi_level_queue<ready_list, priority_levels> pqueue_type;
+    typedef boost::fibers::scheduler::ready_queue_type lqueue_type;
+
+    // 所属池的全局配置, 其共享队列用作注入队列, 并登记了池内所有可被窃取的实例
+    shared_work_global_config& global_config_;
+
+    rqueue_type             rqueue_{};  // 本地队列, 按优先级分级, 可被其他线程窃取
+    pqueue_type             pqueue_{};  // 优先队列, 绑定线程的纤程, 按优先级分级
+    lqueue_type             lqueue_{};  // 本地队列, main context, dispatcher context
+    bool                    suspend_{ false };
+    std::minstd_rand        random_;
+    std::uint32_t           ticks_{ 0 };    // pick_next() 的次数, 用于定期先检查注入队列
+
+    // 每隔该次数的调度先检查注入队列再检查本地队列, 否则反复让出的纤程在LIFO的本地队列中
+    // 总是被立即取回, 注入队列中的纤程永远得不到执行. 取素数以免与任务自身的周期同步
+    enum { fairness_interval = 61 };
+
+    uint32_t                slot_;      // 在空闲线程登记表中的槽位
+    std::size_t             node_;      // 所在的NUMA节点
+
+    boost::fibers::context* steal() noexcept;
+    bool has_stealable() const noexcept;
+
+public:
+    work_stealing_with_properties(shared_work_global_config& config, bool suspend = true);
+    ~work_stealing_with_properties();
+
+    work_stealing_with_properties(work_stealing_with_properties const&) = delete;
+    work_stealing_with_properties(work_stealing_with_properties&&) = delete;
+
+    work_stealing_with_properties& operator=(work_stealing_with_properties const&) = delete;
+    work_stealing_with_properties& operator=(work_stealing_with_properties&&) = delete;
+
+    void awakened(boost::fibers::context* ctx, fiber_properties& props) noexcept override;
+
+    void property_change(boost::fibers::context* ctx, fiber_properties& props) noexcept override;
+
+    boost::fibers::context* pick_next() noexcept override;
+
+    bool has_ready_fibers() const noexcept override;
+
+    void suspend_until(std::chrono::steady_clock::time_point const&) noexcept override;
+
+    void notify() noexcept override;
+
+    // 本地队列中是否有可被窃取的纤程
+    bool stealable() const noexcept {
+        return !rqueue_.empty();
+    }
+};
+
+} // fiber_pool
+
+#endif // work_stealing_h__
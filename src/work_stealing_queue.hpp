@@ -0,0 +1,175 @@
+// This file is part of the fiber_pool library
+//
+// Copyright (c) 2018-2022, zero.kwok@foxmail.com
+// For the full copyright and license information, please view the LICENSE
+// file that was distributed with this source code.
+
+#ifndef work_stealing_queue_h__
+#define work_stealing_queue_h__
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <boost/config.hpp>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace fiber_pool {
+
+/*!
+ *  @brief Chase-Lev 工作窃取双端队列
+ *
+ *  只有拥有者线程可以调用 push() / pop(), 从底部以LIFO的方式存取;
+ *  其他线程(窃取者)通过 steal() 从顶部以FIFO的方式取走元素.
+ *
+ *  @note  参见 David Chase and Yossi Lev. Dynamic circular work-stealing deque.
+ *         以及 Nhat Minh Lê et al. Correct and efficient work-stealing for weak memory models.
+ *         扩容后旧数组可能仍被窃取者访问, 故延迟到析构时统一释放.
+ */
+template<typename T>
+class work_stealing_queue : boost::noncopyable
+{
+    static_assert(std::is_pointer<T>::value, "T must be a pointer type");
+
+    class array
+    {
+        std::int64_t                capacity_;
+        std::vector<std::atomic<T>> storage_;
+
+    public:
+        explicit array(std::int64_t capacity)
+            : capacity_(capacity)
+            , storage_(static_cast<std::size_t>(capacity))
+        {
+        }
+
+        std::int64_t capacity() const noexcept {
+            return capacity_;
+        }
+
+        void put(std::int64_t i, T x) noexcept {
+            storage_[i & (capacity_ - 1)].store(x, std::memory_order_relaxed);
+        }
+
+        T get(std::int64_t i) const noexcept {
+            return storage_[i & (capacity_ - 1)].load(std::memory_order_relaxed);
+        }
+
+        array* grow(std::int64_t top, std::int64_t bottom)
+        {
+            array* a = new array(capacity_ * 2);
+            for (std::int64_t i = top; i != bottom; ++i)
+                a->put(i, get(i));
+            return a;
+        }
+    };
+
+    alignas(64) std::atomic<std::int64_t> top_{ 0 };
+    alignas(64) std::atomic<std::int64_t> bottom_{ 0 };
+    alignas(64) std::atomic<array*>       array_;
+    std::vector<array*>                   garbage_;  // 扩容前的旧数组
+
+public:
+    explicit work_stealing_queue(std::int64_t capacity = 1024)
+        : array_{ new array(capacity) }
+    {
+        BOOST_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    }
+
+    ~work_stealing_queue()
+    {
+        for (auto a : garbage_)
+            delete a;
+        delete array_.load();
+    }
+
+    bool empty() const noexcept
+    {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+        return b <= t;
+    }
+
+    std::size_t size() const noexcept
+    {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+        return static_cast<std::size_t>(b >= t ? b - t : 0);
+    }
+
+    // 仅拥有者线程调用
+    void push(T x)
+    {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        array* a = array_.load(std::memory_order_relaxed);
+
+        if (b - t > a->capacity() - 1)
+        {
+            garbage_.push_back(a);
+            a = a->grow(t, b);
+            array_.store(a, std::memory_order_release);
+        }
+
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // 仅拥有者线程调用, 队列为空时返回nullptr
+    T pop() noexcept
+    {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+
+        T x = nullptr;
+        if (t <= b)
+        {
+            x = a->get(b);
+            if (t == b)
+            {
+                // 最后一个元素, 与窃取者竞争
+                if (!top_.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed))
+                    x = nullptr;
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+
+        return x;
+    }
+
+    // 任意线程调用, 队列为空或竞争失败时返回nullptr
+    T steal() noexcept
+    {
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = bottom_.load(std::memory_order_acquire);
+
+        if (t < b)
+        {
+            array* a = array_.load(std::memory_order_acquire);
+            T x = a->get(t);
+            if (!top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return x;
+        }
+
+        return nullptr;
+    }
+};
+
+} // fiber_pool
+
+#endif // work_stealing_queue_h__